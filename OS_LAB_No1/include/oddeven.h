@@ -0,0 +1,134 @@
+#ifndef ODDEVEN_H
+#define ODDEVEN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ODDEVEN_SYNC_YIELD,
+    ODDEVEN_SYNC_BARRIER,
+    ODDEVEN_SYNC_SLEEP
+} OddEvenSync;
+
+typedef enum {
+    ODDEVEN_ENGINE_TRANSPOSITION,
+    ODDEVEN_ENGINE_BLOCK,
+    /* Stable LSD radix sort over the key bytes; uses the scratch buffer like the block engine. */
+    ODDEVEN_ENGINE_RADIX
+} OddEvenEngine;
+
+typedef enum {
+    ODDEVEN_ALLOC_HEAP,
+    ODDEVEN_ALLOC_MMAP,
+    ODDEVEN_ALLOC_HUGEPAGE,
+    ODDEVEN_ALLOC_FILE
+} OddEvenAlloc;
+
+typedef enum {
+    ODDEVEN_SIMD_AUTO,
+    ODDEVEN_SIMD_SCALAR,
+    ODDEVEN_SIMD_SSE41,
+    ODDEVEN_SIMD_AVX2,
+    ODDEVEN_SIMD_AVX512
+} OddEvenSimd;
+
+/* CPU pinning of the sort threads: none leaves them to the scheduler, compact fills the CPUs
+   of one NUMA node before moving to the next, scatter deals threads round-robin over the nodes. */
+typedef enum {
+    ODDEVEN_AFFINITY_NONE,
+    ODDEVEN_AFFINITY_COMPACT,
+    ODDEVEN_AFFINITY_SCATTER
+} OddEvenAffinity;
+
+typedef enum {
+    ODDEVEN_INT32,
+    ODDEVEN_INT64,
+    ODDEVEN_UINT64,
+    ODDEVEN_FLOAT,
+    ODDEVEN_DOUBLE,
+    ODDEVEN_KV
+} OddEvenType;
+
+/* Element of ODDEVEN_KV arrays, ordered by key only; equal keys keep their order. */
+typedef struct {
+    uint64_t key;
+    uint64_t value;
+} OddEvenKeyValue;
+
+/* Array storage: malloc, anonymous mmap, 2 MB aligned mmap with MADV_HUGEPAGE, or a mapped file. */
+typedef struct {
+    void *data;
+    size_t size;
+    size_t mapped_bytes;
+    OddEvenAlloc mode;
+} OddEvenBuffer;
+
+/* Caller-supplied threads. start runs run(arg) on a new or pooled thread and stores a handle
+   for join; it returns nonzero on success. The context starts its sort threads once and joins
+   them in oddeven_context_destroy; they wait for each other on a phase barrier, so every started
+   run must execute concurrently, not queued behind another. */
+typedef struct {
+    void *user;
+    int (*start)(void *user, int (*run)(void *arg), void *arg, void **handle);
+    void (*join)(void *user, void *handle);
+} OddEvenThreads;
+
+typedef struct {
+    OddEvenType type;
+    OddEvenEngine engine;
+    OddEvenSync sync;
+    OddEvenSimd simd;
+    /* Storage of the block and radix engine scratch buffer. */
+    OddEvenAlloc scratch_alloc;
+    /* Thread count of oddeven_sort; 1 sorts sequentially. */
+    size_t max_threads;
+    /* NULL to create threads with thrd_create. */
+    const OddEvenThreads *threads;
+    /* Applied by each sort thread to itself, also on caller-supplied threads. */
+    OddEvenAffinity affinity;
+    /* Finish early on presorted input: the block and radix engines first check the array in parallel
+       and return if it is sorted, and the block engine sorts its ranges with a natural merge sort
+       that keeps ascending runs. The transposition engine always stops after two quiet phases. */
+    bool adaptive;
+} OddEvenOptions;
+
+/* Reusable sort state: selected kernels, the scratch buffer and the sort threads, kept between sorts.
+   The threads start with the first parallel sort and park on a barrier until the next one. */
+typedef struct OddEvenContext OddEvenContext;
+
+void oddeven_options_init(OddEvenOptions *options);
+
+/* Returns NULL if the requested simd level is not supported by the CPU or the element type. */
+OddEvenContext *oddeven_context_create(const OddEvenOptions *options);
+void oddeven_context_destroy(OddEvenContext *ctx);
+const char *oddeven_kernels_name(const OddEvenContext *ctx);
+
+/* Sort functions return 0 if threads or scratch memory could not be obtained; the array is then
+   left in an unspecified order. */
+int oddeven_sort(OddEvenContext *ctx, void *array, size_t size);
+int oddeven_sort_sequential(OddEvenContext *ctx, void *array, size_t size);
+int oddeven_sort_parallel(OddEvenContext *ctx, void *array, size_t size, size_t max_threads);
+/* Zeroes a freshly allocated array and the scratch buffer from the threads and index ranges that
+   oddeven_sort_parallel would use, so first-touch page placement puts each range on the NUMA node
+   of its thread. Call it before filling the array; returns 0 if some threads could not start. */
+int oddeven_first_touch(OddEvenContext *ctx, void *array, size_t size, size_t max_threads);
+int oddeven_is_sorted(OddEvenType type, const void *array, size_t size);
+size_t oddeven_element_size(OddEvenType type);
+
+int oddeven_buffer_alloc(OddEvenBuffer *buffer, size_t size, size_t elem_size, OddEvenAlloc mode);
+/* Maps an existing file of elem_size elements; with writable the sort result goes to the file. */
+int oddeven_buffer_map_file(OddEvenBuffer *buffer, const char *path, size_t elem_size, bool writable);
+/* Creates or truncates a file of size elements and maps it for writing. */
+int oddeven_buffer_create_file(OddEvenBuffer *buffer, const char *path, size_t size, size_t elem_size);
+void oddeven_buffer_free(OddEvenBuffer *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,188 +1,233 @@
+#define _DEFAULT_SOURCE
+#include "oddeven.h"
+
+#include <errno.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/perf_event.h>
+#include <unistd.h>
+#include <time.h>
 #include <threads.h>
-#include <stdatomic.h>
+#include <stdbool.h>
 
-#define MAX_ARRAY_SIZE 10000
 #define MAX_THREADS 256
+#define FORMAT_CHUNK_ELEMENTS 65536
+#define FORMAT_ELEMENT_CHARS 48
+#define PERF_EVENT_COUNT 5
 
-typedef struct {
-    int *array;
-    size_t size;
-    size_t max_threads;
-    atomic_size_t active_threads;
-    atomic_size_t phase;
-    atomic_bool sorted;
-} SortContext;
+static const char digit_pairs[] =
+    "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+    "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
 
-typedef struct {
-    SortContext *ctx;
-    size_t start_index;
-    size_t end_index;
-} ThreadData;
-
-static void swap(int *a, int *b) {
-    int temp = *a;
-    *a = *b;
-    *b = temp;
+static char *format_u64(char *out, uint64_t value) {
+    char digits[20];
+    char *p = digits + sizeof(digits);
+    while (value >= 100) {
+        const char *pair = digit_pairs + (value % 100) * 2;
+        value /= 100;
+        *--p = pair[1];
+        *--p = pair[0];
+    }
+    if (value >= 10) {
+        *--p = digit_pairs[value * 2 + 1];
+        *--p = digit_pairs[value * 2];
+    } else {
+        *--p = (char)('0' + value);
+    }
+    size_t length = (size_t)(digits + sizeof(digits) - p);
+    memcpy(out, p, length);
+    return out + length;
 }
 
-static int compare_and_swap(int *array, size_t i, size_t j) {
-    if (i >= j || j >= MAX_ARRAY_SIZE) return 0;
-    if (array[i] > array[j]) {
-        swap(&array[i], &array[j]);
-        return 1;
+static char *format_i64(char *out, int64_t value) {
+    if (value < 0) {
+        *out++ = '-';
+        return format_u64(out, -(uint64_t)value);
     }
-    return 0;
+    return format_u64(out, (uint64_t)value);
 }
 
-static int worker_thread(void *arg) {
-    ThreadData *data = (ThreadData *)arg;
-    SortContext *ctx = data->ctx;
-    
-    size_t last_phase = (size_t)-1;
-    
-    while (!atomic_load(&ctx->sorted)) {
-        size_t current_phase = atomic_load(&ctx->phase);
-        
-        if (current_phase != last_phase && current_phase < ctx->size) {
-            last_phase = current_phase;
-            atomic_fetch_add(&ctx->active_threads, 1);
-            
-            size_t start = data->start_index;
-            size_t end = data->end_index;
-            
-            if (current_phase % 2 == 0) {
-                size_t i = (start % 2 == 0) ? start : start + 1;
-                for (; i < end && i + 1 < ctx->size; i += 2) {
-                    compare_and_swap(ctx->array, i, i + 1);
-                }
-            } else {
-                size_t i = (start % 2 == 1) ? start : start + 1;
-                if (i == 0) i = 1;
-                for (; i < end && i + 1 < ctx->size; i += 2) {
-                    compare_and_swap(ctx->array, i, i + 1);
-                }
-            }
-            
-            atomic_fetch_sub(&ctx->active_threads, 1);
+static char *format_element(char *out, const void *array, size_t i, OddEvenType type) {
+    switch (type) {
+        case ODDEVEN_INT32: return format_i64(out, ((const int32_t *)array)[i]);
+        case ODDEVEN_INT64: return format_i64(out, ((const int64_t *)array)[i]);
+        case ODDEVEN_UINT64: return format_u64(out, ((const uint64_t *)array)[i]);
+        case ODDEVEN_FLOAT: return out + snprintf(out, FORMAT_ELEMENT_CHARS, "%g", (double)((const float *)array)[i]);
+        case ODDEVEN_DOUBLE: return out + snprintf(out, FORMAT_ELEMENT_CHARS, "%g", ((const double *)array)[i]);
+        case ODDEVEN_KV:
+            out = format_u64(out, ((const OddEvenKeyValue *)array)[i].key);
+            *out++ = ':';
+            return format_u64(out, ((const OddEvenKeyValue *)array)[i].value);
+    }
+    return out;
+}
+
+typedef struct {
+    const void *array;
+    OddEvenType type;
+    size_t first;
+    size_t last;
+    char *text;
+    size_t length;
+} FormatChunk;
+
+static void format_chunk(FormatChunk *chunk) {
+    char *out = chunk->text;
+    for (size_t i = chunk->first; i < chunk->last; i++) {
+        out = format_element(out, chunk->array, i, chunk->type);
+        *out++ = ' ';
+    }
+    chunk->length = (size_t)(out - chunk->text);
+}
+
+/* Formatting threads of one print: started once and woken for each round by bumping round;
+   pending counts the threads still formatting their chunk of the current round */
+typedef struct {
+    mtx_t mutex;
+    cnd_t start;
+    cnd_t done;
+    unsigned long round;
+    size_t pending;
+    int shutdown;
+    FormatChunk chunk[MAX_THREADS];
+} FormatPool;
+
+typedef struct {
+    FormatPool *pool;
+    size_t index;
+} FormatWorker;
+
+static int format_worker(void *arg) {
+    FormatWorker *worker = (FormatWorker *)arg;
+    FormatPool *pool = worker->pool;
+    unsigned long seen = 0;
+    for (;;) {
+        mtx_lock(&pool->mutex);
+        while (pool->round == seen && !pool->shutdown) {
+            cnd_wait(&pool->start, &pool->mutex);
         }
-        
-        thrd_yield();
+        seen = pool->round;
+        int shutdown = pool->shutdown;
+        mtx_unlock(&pool->mutex);
+        if (shutdown) break;
+        format_chunk(&pool->chunk[worker->index]);
+        mtx_lock(&pool->mutex);
+        if (--pool->pending == 0) cnd_signal(&pool->done);
+        mtx_unlock(&pool->mutex);
     }
-    
     return 0;
 }
 
-static int is_sorted(int *array, size_t size) {
-    for (size_t i = 0; i + 1 < size; i++) {
-        if (array[i] > array[i + 1]) {
+static int write_all(struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(STDOUT_FILENO, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
             return 0;
         }
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
     }
     return 1;
 }
 
-static void batcher_sort_parallel(int *array, size_t size, size_t max_threads) {
-    if (size <= 1) return;
-    
-    SortContext ctx;
-    ctx.array = array;
-    ctx.size = size;
-    ctx.max_threads = max_threads;
-    atomic_init(&ctx.active_threads, 0);
-    atomic_init(&ctx.phase, 0);
-    atomic_init(&ctx.sorted, 0);
+static void print_array(const void *array, size_t size, OddEvenType type, size_t max_threads) {
+    size_t chunk_elements = size < FORMAT_CHUNK_ELEMENTS ? size : FORMAT_CHUNK_ELEMENTS;
+    if (chunk_elements == 0) chunk_elements = 1;
+    size_t chunks = (size + chunk_elements - 1) / chunk_elements;
+    size_t workers = max_threads < chunks ? max_threads : chunks;
+    if (workers > MAX_THREADS) workers = MAX_THREADS;
+    if (workers == 0) workers = 1;
     
-    size_t threads_to_create = max_threads;
-    if (threads_to_create > size / 2) {
-        threads_to_create = size / 2;
-    }
-    if (threads_to_create == 0) {
-        threads_to_create = 1;
-    }
-    if (threads_to_create > MAX_THREADS) {
-        threads_to_create = MAX_THREADS;
+    size_t chunk_bytes = chunk_elements * (FORMAT_ELEMENT_CHARS + 1);
+    char *text = malloc(workers * chunk_bytes);
+    if (text == NULL) {
+        fprintf(stderr, "Error: failed to allocate output buffer\n");
+        return;
     }
+    fflush(stdout);
     
+    /* A single chunk is formatted inline; otherwise the workers live for the whole print */
+    FormatPool pool = { .round = 0, .pending = 0, .shutdown = 0 };
+    FormatWorker worker[MAX_THREADS];
     thrd_t threads[MAX_THREADS];
-    ThreadData thread_data[MAX_THREADS];
-    
-    size_t elements_per_thread = size / threads_to_create;
-    if (elements_per_thread == 0) elements_per_thread = 1;
-    
-    for (size_t i = 0; i < threads_to_create; i++) {
-        thread_data[i].ctx = &ctx;
-        thread_data[i].start_index = i * elements_per_thread;
-        thread_data[i].end_index = (i == threads_to_create - 1) ? size : (i + 1) * elements_per_thread;
-        
-        if (thrd_create(&threads[i], worker_thread, &thread_data[i]) != thrd_success) {
-            fprintf(stderr, "Error: failed to create thread %zu\n", i);
-            atomic_store(&ctx.sorted, 1);
-            for (size_t j = 0; j < i; j++) {
-                thrd_join(threads[j], NULL);
-            }
-            return;
+    size_t started = 1;
+    if (workers > 1) {
+        mtx_init(&pool.mutex, mtx_plain);
+        cnd_init(&pool.start);
+        cnd_init(&pool.done);
+        for (; started < workers; started++) {
+            worker[started] = (FormatWorker){ &pool, started };
+            if (thrd_create(&threads[started], format_worker, &worker[started]) != thrd_success) break;
         }
     }
-    
-    size_t max_phases = size;
-    for (size_t phase = 0; phase < max_phases; phase++) {
-        atomic_store(&ctx.phase, phase);
-        
-        while (atomic_load(&ctx.active_threads) < threads_to_create) {
-            thrd_yield();
+    FormatChunk *chunk = pool.chunk;
+    struct iovec iov[MAX_THREADS];
+    for (size_t first = 0; first < size; first += workers * chunk_elements) {
+        size_t count = 0;
+        for (size_t start = first; count < workers; start += chunk_elements) {
+            if (start > size) start = size;
+            size_t last = size - start > chunk_elements ? start + chunk_elements : size;
+            chunk[count] = (FormatChunk){ array, type, start, last, text + count * chunk_bytes, 0 };
+            count++;
         }
-        
-        while (atomic_load(&ctx.active_threads) > 0) {
-            thrd_yield();
+        if (started > 1) {
+            mtx_lock(&pool.mutex);
+            pool.pending = started - 1;
+            pool.round++;
+            cnd_broadcast(&pool.start);
+            mtx_unlock(&pool.mutex);
         }
-        
-        if (is_sorted(array, size)) {
-            atomic_store(&ctx.sorted, 1);
-            break;
+        format_chunk(&chunk[0]);
+        for (size_t i = started; i < count; i++) {
+            format_chunk(&chunk[i]);
         }
-    }
-    
-    atomic_store(&ctx.sorted, 1);
-    
-    for (size_t i = 0; i < threads_to_create; i++) {
-        thrd_join(threads[i], NULL);
-    }
-}
-
-static void batcher_sort_sequential(int *array, size_t size) {
-    if (size <= 1) return;
-    
-    int sorted = 0;
-    size_t max_phases = size;
-    
-    for (size_t phase = 0; phase < max_phases && !sorted; phase++) {
-        sorted = 1;
-        
-        if (phase % 2 == 0) {
-            for (size_t i = 0; i + 1 < size; i += 2) {
-                if (compare_and_swap(array, i, i + 1)) {
-                    sorted = 0;
-                }
-            }
-        } else {
-            for (size_t i = 1; i + 1 < size; i += 2) {
-                if (compare_and_swap(array, i, i + 1)) {
-                    sorted = 0;
-                }
+        if (started > 1) {
+            mtx_lock(&pool.mutex);
+            while (pool.pending > 0) {
+                cnd_wait(&pool.done, &pool.mutex);
             }
+            mtx_unlock(&pool.mutex);
+        }
+        /* chunks past the end of the array are empty in the last round */
+        while (count > 1 && chunk[count - 1].length == 0) count--;
+        for (size_t i = 0; i < count; i++) {
+            iov[i].iov_base = chunk[i].text;
+            iov[i].iov_len = chunk[i].length;
+        }
+        if (chunk[count - 1].last == size) {
+            chunk[count - 1].text[chunk[count - 1].length - 1] = '\n';
+        }
+        if (!write_all(iov, (int)count)) {
+            fprintf(stderr, "Error: failed to write array\n");
+            break;
         }
     }
-}
-
-static void print_array(int *array, size_t size) {
-    for (size_t i = 0; i < size; i++) {
-        printf("%d", array[i]);
-        if (i + 1 < size) {
-            printf(" ");
+    if (workers > 1) {
+        mtx_lock(&pool.mutex);
+        pool.shutdown = 1;
+        cnd_broadcast(&pool.start);
+        mtx_unlock(&pool.mutex);
+        for (size_t i = 1; i < started; i++) {
+            thrd_join(threads[i], NULL);
         }
+        mtx_destroy(&pool.mutex);
+        cnd_destroy(&pool.start);
+        cnd_destroy(&pool.done);
     }
-    printf("\n");
+    free(text);
 }
 
 static int parse_unsigned(const char *str, size_t *result) {
@@ -230,12 +275,357 @@ static int parse_int(const char *str, int *result) {
     return 1;
 }
 
+static int parse_u64(const char *str, char **end, uint64_t *result) {
+    if (*str < '0' || *str > '9') return 0;
+    errno = 0;
+    *result = strtoull(str, end, 10);
+    return errno == 0;
+}
+
+static int parse_element(const char *str, void *array, size_t i, OddEvenType type) {
+    char *end = NULL;
+    errno = 0;
+    switch (type) {
+        case ODDEVEN_INT32:
+            return parse_int(str, &((int *)array)[i]);
+        case ODDEVEN_INT64:
+            ((int64_t *)array)[i] = strtoll(str, &end, 10);
+            break;
+        case ODDEVEN_UINT64:
+            if (!parse_u64(str, &end, &((uint64_t *)array)[i])) return 0;
+            break;
+        case ODDEVEN_FLOAT:
+            ((float *)array)[i] = strtof(str, &end);
+            break;
+        case ODDEVEN_DOUBLE:
+            ((double *)array)[i] = strtod(str, &end);
+            break;
+        case ODDEVEN_KV: {
+            OddEvenKeyValue *item = &((OddEvenKeyValue *)array)[i];
+            if (!parse_u64(str, &end, &item->key)) return 0;
+            item->value = i;
+            if (*end == ':' && !parse_u64(end + 1, &end, &item->value)) return 0;
+            break;
+        }
+    }
+    return end != str && *end == '\0' && errno == 0;
+}
+
+static void generate_element(void *array, size_t i, OddEvenType type, int value) {
+    switch (type) {
+        case ODDEVEN_INT32: ((int32_t *)array)[i] = value; break;
+        case ODDEVEN_INT64: ((int64_t *)array)[i] = ((int64_t)value - 500) * 1000000007; break;
+        case ODDEVEN_UINT64: ((uint64_t *)array)[i] = (uint64_t)value * UINT64_C(18446744073709551); break;
+        case ODDEVEN_FLOAT: ((float *)array)[i] = (float)(value - 500) / 8.0f; break;
+        case ODDEVEN_DOUBLE: ((double *)array)[i] = (double)(value - 500) / 3.0; break;
+        case ODDEVEN_KV:
+            ((OddEvenKeyValue *)array)[i].key = (uint64_t)value;
+            ((OddEvenKeyValue *)array)[i].value = i;
+            break;
+    }
+}
+
+static const char *element_type_name(OddEvenType type) {
+    switch (type) {
+        case ODDEVEN_INT64: return "int64";
+        case ODDEVEN_UINT64: return "uint64";
+        case ODDEVEN_FLOAT: return "float";
+        case ODDEVEN_DOUBLE: return "double";
+        case ODDEVEN_KV: return "kv";
+        default: return "int32";
+    }
+}
+
+static int parse_element_type(const char *str, OddEvenType *result) {
+    for (int type = ODDEVEN_INT32; type <= ODDEVEN_KV; type++) {
+        if (strcmp(str, element_type_name((OddEvenType)type)) == 0) {
+            *result = (OddEvenType)type;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static const char *sync_mode_name(OddEvenSync sync) {
+    switch (sync) {
+        case ODDEVEN_SYNC_BARRIER: return "barrier";
+        case ODDEVEN_SYNC_SLEEP: return "sleep";
+        default: return "yield";
+    }
+}
+
+static int parse_sync_mode(const char *str, OddEvenSync *result) {
+    if (strcmp(str, "yield") == 0) {
+        *result = ODDEVEN_SYNC_YIELD;
+    } else if (strcmp(str, "barrier") == 0) {
+        *result = ODDEVEN_SYNC_BARRIER;
+    } else if (strcmp(str, "sleep") == 0) {
+        *result = ODDEVEN_SYNC_SLEEP;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static const char *sort_engine_name(OddEvenEngine engine) {
+    switch (engine) {
+        case ODDEVEN_ENGINE_BLOCK: return "block";
+        case ODDEVEN_ENGINE_RADIX: return "radix";
+        default: return "transposition";
+    }
+}
+
+static int parse_sort_engine(const char *str, OddEvenEngine *result) {
+    if (strcmp(str, "transposition") == 0) {
+        *result = ODDEVEN_ENGINE_TRANSPOSITION;
+    } else if (strcmp(str, "block") == 0) {
+        *result = ODDEVEN_ENGINE_BLOCK;
+    } else if (strcmp(str, "radix") == 0) {
+        *result = ODDEVEN_ENGINE_RADIX;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static int parse_alloc_mode(const char *str, OddEvenAlloc *result) {
+    if (strcmp(str, "heap") == 0) {
+        *result = ODDEVEN_ALLOC_HEAP;
+    } else if (strcmp(str, "mmap") == 0) {
+        *result = ODDEVEN_ALLOC_MMAP;
+    } else if (strcmp(str, "hugepage") == 0) {
+        *result = ODDEVEN_ALLOC_HUGEPAGE;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static int parse_affinity(const char *str, OddEvenAffinity *result) {
+    if (strcmp(str, "none") == 0) {
+        *result = ODDEVEN_AFFINITY_NONE;
+    } else if (strcmp(str, "compact") == 0) {
+        *result = ODDEVEN_AFFINITY_COMPACT;
+    } else if (strcmp(str, "scatter") == 0) {
+        *result = ODDEVEN_AFFINITY_SCATTER;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static int parse_simd_level(const char *str, OddEvenSimd *result) {
+    if (strcmp(str, "auto") == 0) {
+        *result = ODDEVEN_SIMD_AUTO;
+    } else if (strcmp(str, "scalar") == 0) {
+        *result = ODDEVEN_SIMD_SCALAR;
+    } else if (strcmp(str, "sse4.1") == 0) {
+        *result = ODDEVEN_SIMD_SSE41;
+    } else if (strcmp(str, "avx2") == 0) {
+        *result = ODDEVEN_SIMD_AVX2;
+    } else if (strcmp(str, "avx512") == 0) {
+        *result = ODDEVEN_SIMD_AVX512;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+/* Cache counters of the sort, user space only, inherited by the sort threads. HITM (a load served
+   from a line modified in another core's cache, i.e. true or false sharing) has no generic perf
+   event; on Intel it is MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM (XSNP_FWD on newer cores), raw 0x04d2. */
+typedef struct {
+    int fds[PERF_EVENT_COUNT];
+} PerfCounters;
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+} perf_events[PERF_EVENT_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, "cache references" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache misses" },
+    { PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      "L1d load misses" },
+    { PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      "LLC load misses" },
+    { PERF_TYPE_RAW, 0x04d2, "HITM loads" },
+};
+
+static void perf_counters_open(PerfCounters *counters) {
+    for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        counters->fds[i] = -1;
+#if defined(__x86_64__) || defined(__i386__)
+        if (perf_events[i].type == PERF_TYPE_RAW && !__builtin_cpu_is("intel")) continue;
+#else
+        if (perf_events[i].type == PERF_TYPE_RAW) continue;
+#endif
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = perf_events[i].type;
+        attr.config = perf_events[i].config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        counters->fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+static void perf_counters_enable(const PerfCounters *counters, bool enable) {
+    for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (counters->fds[i] >= 0) ioctl(counters->fds[i], enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+    }
+}
+
+static void perf_counters_report(PerfCounters *counters) {
+    printf("Perf counters of the sort (user space, all threads):\n");
+    for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        uint64_t value;
+        if (counters->fds[i] < 0 || read(counters->fds[i], &value, sizeof(value)) != (ssize_t)sizeof(value)) {
+            printf("  %-17s not available\n", perf_events[i].name);
+        } else {
+            printf("  %-17s %llu\n", perf_events[i].name, (unsigned long long)value);
+        }
+        if (counters->fds[i] >= 0) close(counters->fds[i]);
+    }
+}
+
+/* Order of generated input: random, ascending, ascending with every 100th element random, or
+   ascending with a random tail of 1% of the elements, like a log with a fresh batch appended. */
+typedef enum {
+    ORDER_RANDOM,
+    ORDER_SORTED,
+    ORDER_NEARLY,
+    ORDER_APPENDED
+} InputOrder;
+
+static int parse_input_order(const char *text, InputOrder *order) {
+    if (strcmp(text, "random") == 0) {
+        *order = ORDER_RANDOM;
+    } else if (strcmp(text, "sorted") == 0) {
+        *order = ORDER_SORTED;
+    } else if (strcmp(text, "nearly") == 0) {
+        *order = ORDER_NEARLY;
+    } else if (strcmp(text, "appended") == 0) {
+        *order = ORDER_APPENDED;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+typedef struct {
+    OddEvenSync sync;
+    OddEvenEngine engine;
+    OddEvenAlloc alloc;
+    OddEvenSimd simd;
+    OddEvenType type;
+    OddEvenAffinity affinity;
+    InputOrder order;
+    const char *input;
+    const char *output;
+    bool first_touch;
+    bool adaptive;
+    bool perf;
+    bool quiet;
+} Options;
+
+static int parse_options(int argc, char **argv, int *first_positional, Options *options) {
+    int i = 1;
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+        if (strncmp(argv[i], "--sync=", 7) == 0) {
+            if (!parse_sync_mode(argv[i] + 7, &options->sync)) {
+                fprintf(stderr, "Error: invalid sync mode '%s'\n", argv[i] + 7);
+                return 0;
+            }
+        } else if (strncmp(argv[i], "--engine=", 9) == 0) {
+            if (!parse_sort_engine(argv[i] + 9, &options->engine)) {
+                fprintf(stderr, "Error: invalid engine '%s'\n", argv[i] + 9);
+                return 0;
+            }
+        } else if (strncmp(argv[i], "--alloc=", 8) == 0) {
+            if (!parse_alloc_mode(argv[i] + 8, &options->alloc)) {
+                fprintf(stderr, "Error: invalid alloc mode '%s'\n", argv[i] + 8);
+                return 0;
+            }
+        } else if (strncmp(argv[i], "--simd=", 7) == 0) {
+            if (!parse_simd_level(argv[i] + 7, &options->simd)) {
+                fprintf(stderr, "Error: invalid simd level '%s'\n", argv[i] + 7);
+                return 0;
+            }
+        } else if (strncmp(argv[i], "--type=", 7) == 0) {
+            if (!parse_element_type(argv[i] + 7, &options->type)) {
+                fprintf(stderr, "Error: invalid element type '%s'\n", argv[i] + 7);
+                return 0;
+            }
+        } else if (strncmp(argv[i], "--affinity=", 11) == 0) {
+            if (!parse_affinity(argv[i] + 11, &options->affinity)) {
+                fprintf(stderr, "Error: invalid affinity '%s'\n", argv[i] + 11);
+                return 0;
+            }
+        } else if (strncmp(argv[i], "--order=", 8) == 0) {
+            if (!parse_input_order(argv[i] + 8, &options->order)) {
+                fprintf(stderr, "Error: invalid input order '%s'\n", argv[i] + 8);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            options->adaptive = true;
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            options->perf = true;
+        } else if (strcmp(argv[i], "--first-touch") == 0) {
+            options->first_touch = true;
+        } else if (strncmp(argv[i], "--input=", 8) == 0) {
+            options->input = argv[i] + 8;
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            options->output = argv[i] + 9;
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            options->quiet = true;
+        } else {
+            fprintf(stderr, "Error: unknown option '%s'\n", argv[i]);
+            return 0;
+        }
+    }
+    *first_positional = i;
+    return 1;
+}
+
 int main(int argc, char **argv) {
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <max_threads> <array_size> [elements...]\n", argv[0]);
+    Options options = { .sync = ODDEVEN_SYNC_SLEEP, .engine = ODDEVEN_ENGINE_TRANSPOSITION, .alloc = ODDEVEN_ALLOC_HEAP,
+                        .simd = ODDEVEN_SIMD_AUTO, .type = ODDEVEN_INT32, .affinity = ODDEVEN_AFFINITY_NONE,
+                        .order = ORDER_RANDOM, .input = NULL, .output = NULL, .first_touch = false, .adaptive = false,
+                        .perf = false, .quiet = false };
+    int arg;
+    if (!parse_options(argc, argv, &arg, &options)) {
+        return 1;
+    }
+    argc -= arg - 1;
+    argv += arg - 1;
+    
+    if (argc < (options.input != NULL ? 2 : 3)) {
+        fprintf(stderr, "Usage: %s [options] <max_threads> <array_size> [elements...]\n", argv[0]);
+        fprintf(stderr, "       %s [options] --input=FILE <max_threads>\n", argv[0]);
         fprintf(stderr, "  max_threads: maximum number of threads (1 for sequential)\n");
-        fprintf(stderr, "  array_size: number of elements in array (max %d)\n", MAX_ARRAY_SIZE);
-        fprintf(stderr, "  elements: optional list of integers (if not provided, random values will be used)\n");
+        fprintf(stderr, "  array_size: number of elements in array\n");
+        fprintf(stderr, "  elements: optional list of values, key or key:value for kv (if not provided, random values will be used)\n");
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "  --sync=yield|barrier|sleep: phase synchronization of parallel sort (default: sleep)\n");
+        fprintf(stderr, "  --engine=transposition|block|radix: odd-even transposition, block merge-split or LSD radix (default: transposition)\n");
+        fprintf(stderr, "  --alloc=heap|mmap|hugepage: array storage (default: heap)\n");
+        fprintf(stderr, "  --simd=auto|scalar|sse4.1|avx2|avx512: compare-swap kernels (default: auto, by CPU)\n");
+        fprintf(stderr, "  --affinity=none|compact|scatter: pin sort threads filling NUMA nodes one by one or round-robin (default: none)\n");
+        fprintf(stderr, "  --first-touch: zero the array and scratch from the sort threads before filling it, placing each range on its node\n");
+        fprintf(stderr, "  --adaptive: return early on sorted input and keep ascending runs in the block engine\n");
+        fprintf(stderr, "  --order=random|sorted|nearly|appended: generated input, nearly is sorted with every 100th element random,\n");
+        fprintf(stderr, "      appended is sorted with a random 1%% tail (default: random)\n");
+        fprintf(stderr, "  --type=int32|int64|uint64|float|double|kv: element type (default: int32)\n");
+        fprintf(stderr, "  --input=FILE: sort a raw binary file of --type elements in place through mmap\n");
+        fprintf(stderr, "  --output=FILE: write the sorted array to a raw binary file through mmap (input stays unchanged)\n");
+        fprintf(stderr, "  --perf: report cache misses and HITM loads of the sort from hardware counters\n");
+        fprintf(stderr, "  --quiet: do not print the original and sorted arrays\n");
         return 1;
     }
     
@@ -245,54 +635,132 @@ int main(int argc, char **argv) {
         return 1;
     }
     
-    size_t array_size;
-    if (!parse_unsigned(argv[2], &array_size) || array_size == 0) {
+    size_t array_size = 0;
+    if (options.input == NULL && (!parse_unsigned(argv[2], &array_size) || array_size == 0)) {
         fprintf(stderr, "Error: invalid array_size value\n");
         return 1;
     }
     
-    if (array_size > MAX_ARRAY_SIZE) {
-        fprintf(stderr, "Error: array_size exceeds maximum of %d\n", MAX_ARRAY_SIZE);
+    OddEvenOptions sort_options;
+    oddeven_options_init(&sort_options);
+    sort_options.type = options.type;
+    sort_options.engine = options.engine;
+    sort_options.sync = options.sync;
+    sort_options.simd = options.simd;
+    sort_options.scratch_alloc = options.alloc;
+    sort_options.max_threads = max_threads;
+    sort_options.affinity = options.affinity;
+    sort_options.adaptive = options.adaptive;
+    OddEvenContext *ctx = oddeven_context_create(&sort_options);
+    if (ctx == NULL) {
+        fprintf(stderr, "Error: requested simd level is not supported by this CPU or element type\n");
         return 1;
     }
+    size_t elem_size = oddeven_element_size(options.type);
     
-    int array[MAX_ARRAY_SIZE];
+    OddEvenBuffer buffer;
+    if (options.input != NULL) {
+        OddEvenBuffer input;
+        if (!oddeven_buffer_map_file(&input, options.input, elem_size, options.output == NULL)) {
+            oddeven_context_destroy(ctx);
+            return 1;
+        }
+        array_size = input.size;
+        buffer = input;
+        if (options.output != NULL) {
+            if (!oddeven_buffer_create_file(&buffer, options.output, array_size, elem_size)) {
+                oddeven_buffer_free(&input);
+                oddeven_context_destroy(ctx);
+                return 1;
+            }
+            memcpy(buffer.data, input.data, input.mapped_bytes);
+            oddeven_buffer_free(&input);
+        }
+        printf("Mapped %zu %s elements from %s\n", array_size, element_type_name(options.type), options.input);
+    } else if (options.output != NULL) {
+        if (!oddeven_buffer_create_file(&buffer, options.output, array_size, elem_size)) {
+            oddeven_context_destroy(ctx);
+            return 1;
+        }
+    } else if (!oddeven_buffer_alloc(&buffer, array_size, elem_size, options.alloc)) {
+        fprintf(stderr, "Error: failed to allocate array of %zu elements\n", array_size);
+        oddeven_context_destroy(ctx);
+        return 1;
+    }
+    void *array = buffer.data;
+    bool file_mode = options.input != NULL || options.output != NULL;
+    
+    if (options.first_touch && options.input == NULL && max_threads > 1 &&
+        !oddeven_first_touch(ctx, array, array_size, max_threads)) {
+        fprintf(stderr, "Warning: first touch ran partly on the main thread\n");
+    }
     
-    if (argc >= 3 + (int)array_size) {
+    if (options.input == NULL && (size_t)(argc - 3) >= array_size) {
         for (size_t i = 0; i < array_size; i++) {
-            if (!parse_int(argv[3 + i], &array[i])) {
-                fprintf(stderr, "Error: invalid integer at position %zu\n", i);
+            if (!parse_element(argv[3 + i], array, i, options.type)) {
+                fprintf(stderr, "Error: invalid %s value at position %zu\n", element_type_name(options.type), i);
+                oddeven_buffer_free(&buffer);
+                oddeven_context_destroy(ctx);
                 return 1;
             }
         }
-    } else {
-        int seed = 42;
+    } else if (options.input == NULL) {
+        uint32_t seed = 42;
         for (size_t i = 0; i < array_size; i++) {
-            seed = seed * 1103515245 + 12345;
-            if (seed < 0) seed = -seed;
-            array[i] = (seed / 65536) % 1000;
+            seed = seed * 1103515245u + 12345u;
+            if (seed >= 0x80000000u) seed = -seed;
+            int value = (int)((seed / 65536) % 1000);
+            bool random = options.order == ORDER_RANDOM || (options.order == ORDER_NEARLY && i % 100 == 0) ||
+                          (options.order == ORDER_APPENDED && i >= array_size - array_size / 100);
+            if (!random) {
+                value = (int)(i * 1000 / array_size);
+            }
+            generate_element(array, i, options.type, value);
         }
     }
     
-    printf("Original array: ");
-    print_array(array, array_size);
+    if (!options.quiet && !file_mode) {
+        printf("Original array: ");
+        print_array(array, array_size, options.type, max_threads);
+    }
     
     if (max_threads == 1) {
-        printf("Using sequential sort\n");
-        batcher_sort_sequential(array, array_size);
+        printf("Using sequential sort (%s elements, %s engine, %s kernels)\n", element_type_name(options.type),
+               sort_engine_name(options.engine), oddeven_kernels_name(ctx));
     } else {
-        printf("Using parallel sort with max %zu threads\n", max_threads);
-        batcher_sort_parallel(array, array_size, max_threads);
+        printf("Using parallel sort with max %zu threads (%s elements, %s engine, %s sync, %s kernels)\n", max_threads,
+               element_type_name(options.type), sort_engine_name(options.engine), sync_mode_name(options.sync),
+               oddeven_kernels_name(ctx));
+    }
+    struct timespec started, finished;
+    PerfCounters counters;
+    if (options.perf) {
+        perf_counters_open(&counters);
+        perf_counters_enable(&counters, true);
     }
+    timespec_get(&started, TIME_UTC);
+    int sorted = oddeven_sort(ctx, array, array_size);
+    timespec_get(&finished, TIME_UTC);
+    if (options.perf) perf_counters_enable(&counters, false);
+    oddeven_context_destroy(ctx);
     
-    printf("Sorted array: ");
-    print_array(array, array_size);
+    sorted = sorted && oddeven_is_sorted(options.type, array, array_size);
+    
+    if (file_mode) {
+        printf("Sorted array written to %s\n", options.output != NULL ? options.output : options.input);
+    } else if (!options.quiet) {
+        printf("Sorted array: ");
+        print_array(array, array_size, options.type, max_threads);
+    }
     
-    if (!is_sorted(array, array_size)) {
+    oddeven_buffer_free(&buffer);
+    if (!sorted) {
         fprintf(stderr, "Error: array is not sorted correctly\n");
         return 1;
     }
     
-    printf("Sort completed successfully\n");
+    double elapsed = (double)(finished.tv_sec - started.tv_sec) + (double)(finished.tv_nsec - started.tv_nsec) / 1e9;
+    printf("Sort completed successfully in %.6f seconds\n", elapsed);
+    if (options.perf) perf_counters_report(&counters);
     return 0;
 }
@@ -0,0 +1,1513 @@
+#define _GNU_SOURCE
+#include "oddeven.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <sched.h>
+#include <pthread.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+#define MAX_THREADS 256
+#define CACHE_LINE 64
+#define BARRIER_SPINS_BEFORE_YIELD 64
+#define BARRIER_SPINS_BEFORE_SLEEP 4096
+#define HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+#define INSERTION_SORT_THRESHOLD 16
+#define NETWORK_MAX_LANES 16
+#define NETWORK_MAX_STAGES 10
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_WC_BYTES 64
+#define MAX_NUMA_NODES 64
+#define MERGE_STACK_DEPTH 128
+
+typedef int (*PairKernel)(void *array, size_t first, size_t last);
+typedef void (*BlockSortKernel)(void *array, size_t size);
+typedef void (*MergeKernel)(const void *src, void *dst, size_t left, size_t mid, size_t right);
+typedef void (*SplitKernel)(const void *low, size_t low_size, const void *high, size_t high_size, void *out);
+typedef int (*OrderKernel)(const void *array, size_t i, size_t j);
+/* Returns the first i in [first, last) with array[i] < array[i - 1], or last; first is at least 1. */
+typedef size_t (*DescentKernel)(const void *array, size_t first, size_t last);
+typedef void (*RadixCountKernel)(const void *array, size_t first, size_t last, unsigned shift, size_t *count);
+typedef void (*RadixScatterKernel)(const void *src, void *dst, size_t first, size_t last, unsigned shift,
+                                   size_t *offset);
+
+typedef struct {
+    const char *name;
+    size_t elem_size;
+    PairKernel compare_pairs;
+    BlockSortKernel sort_blocks;
+    size_t block_width;
+    MergeKernel merge_runs;
+    SplitKernel merge_split_low;
+    SplitKernel merge_split_high;
+    OrderKernel out_of_order;
+    DescentKernel first_descent;
+    RadixCountKernel radix_count;
+    RadixScatterKernel radix_scatter;
+    unsigned key_bits;
+} SimdKernels;
+
+typedef struct {
+    int32_t partner[NETWORK_MAX_STAGES][NETWORK_MAX_LANES];
+    int32_t take_max[NETWORK_MAX_STAGES][NETWORK_MAX_LANES];
+    uint32_t max_mask[NETWORK_MAX_STAGES];
+    size_t stages;
+} NetworkTable;
+
+/* Arrivals hammer count; waiters spin on sense, which changes once per phase. */
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_size_t count;
+    _Alignas(CACHE_LINE) atomic_bool sense;
+    size_t parties;
+    bool sleep;
+    mtx_t mutex;
+    cnd_t cond;
+} PhaseBarrier;
+
+typedef struct ThreadData ThreadData;
+typedef struct WorkerPool WorkerPool;
+
+/* Thread i of a parallel sort runs on cpus[i % count]; count 0 leaves placement to the scheduler. */
+typedef struct {
+    int cpus[CPU_SETSIZE];
+    size_t count;
+} CpuPlacement;
+
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_bool value;
+} PaddedFlag;
+
+/* Fields written during a sort get cache lines of their own, apart from the read-only ones. */
+typedef struct {
+    void *array;
+    void *scratch;
+    size_t size;
+    size_t max_threads;
+    OddEvenSync sync;
+    OddEvenEngine engine;
+    bool adaptive;
+    const SimdKernels *kernels;
+    const CpuPlacement *placement;
+    ThreadData *thread_data;
+    size_t thread_count;
+    size_t (*radix_counts)[RADIX_BUCKETS];
+    /* Written by the coordinator, polled by workers. */
+    _Alignas(CACHE_LINE) atomic_size_t phase;
+    atomic_bool sorted;
+    atomic_bool released;
+    atomic_bool aborted;
+    /* Incremented and decremented by every worker in each yield phase. */
+    _Alignas(CACHE_LINE) atomic_size_t active_threads;
+    PaddedFlag changed[3];
+    /* Set by the adaptive pre-check of any thread that found a descent in or after its range. */
+    PaddedFlag unsorted;
+    PhaseBarrier barrier;
+} SortContext;
+
+/* One cache line per thread, so neighbours in the thread_data array do not share lines. */
+struct ThreadData {
+    _Alignas(CACHE_LINE) SortContext *ctx;
+    WorkerPool *pool;
+    thrd_start_t run;
+    size_t index;
+    size_t start_index;
+    size_t end_index;
+    thrd_t thread;
+    void *handle;
+};
+
+/* Sort threads kept between sorts. They park on the park barrier together with the calling thread;
+   a job passes it twice: once to start the workers and once to wait until they are done. */
+struct WorkerPool {
+    SortContext ctx;
+    ThreadData thread_data[MAX_THREADS];
+    size_t size;
+    const OddEvenThreads *threads;
+    /* Worker function of the current job, NULL to stop the threads. */
+    thrd_start_t job;
+    PhaseBarrier park;
+    bool park_sense;
+};
+
+struct OddEvenContext {
+    OddEvenOptions options;
+    OddEvenThreads threads;
+    const SimdKernels *kernels;
+    OddEvenBuffer scratch;
+    CpuPlacement placement;
+    WorkerPool *pool;
+};
+
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/* Prepares a barrier for another sort; nobody may be waiting on it. The mutex and condition
+   variable are created once by phase_barrier_init whatever the wait mode. */
+static void phase_barrier_reset(PhaseBarrier *barrier, size_t parties, bool sleep) {
+    atomic_store(&barrier->count, 0);
+    atomic_store(&barrier->sense, 0);
+    barrier->parties = parties;
+    barrier->sleep = sleep;
+}
+
+static int phase_barrier_init(PhaseBarrier *barrier, size_t parties, bool sleep) {
+    atomic_init(&barrier->count, 0);
+    atomic_init(&barrier->sense, 0);
+    phase_barrier_reset(barrier, parties, sleep);
+    if (mtx_init(&barrier->mutex, mtx_plain) != thrd_success) return 0;
+    if (cnd_init(&barrier->cond) != thrd_success) {
+        mtx_destroy(&barrier->mutex);
+        return 0;
+    }
+    return 1;
+}
+
+static void phase_barrier_destroy(PhaseBarrier *barrier) {
+    cnd_destroy(&barrier->cond);
+    mtx_destroy(&barrier->mutex);
+}
+
+static void phase_barrier_wait(PhaseBarrier *barrier, bool *local_sense) {
+    bool sense = !*local_sense;
+    *local_sense = sense;
+
+    if (atomic_fetch_add(&barrier->count, 1) == barrier->parties - 1) {
+        atomic_store(&barrier->count, 0);
+        if (barrier->sleep) {
+            mtx_lock(&barrier->mutex);
+            atomic_store(&barrier->sense, sense);
+            cnd_broadcast(&barrier->cond);
+            mtx_unlock(&barrier->mutex);
+        } else {
+            atomic_store(&barrier->sense, sense);
+        }
+        return;
+    }
+
+    for (size_t spins = 1; atomic_load(&barrier->sense) != sense; spins++) {
+        if (barrier->sleep && spins >= BARRIER_SPINS_BEFORE_SLEEP) {
+            mtx_lock(&barrier->mutex);
+            while (atomic_load(&barrier->sense) != sense) {
+                cnd_wait(&barrier->cond, &barrier->mutex);
+            }
+            mtx_unlock(&barrier->mutex);
+            return;
+        }
+        if (spins % BARRIER_SPINS_BEFORE_YIELD == 0) {
+            thrd_yield();
+        } else {
+            cpu_relax();
+        }
+    }
+}
+
+#define SCALAR_KEY(x) (x)
+#define KV_KEY(x) ((x).key)
+
+#define DEFINE_ELEMENT_KERNELS(NAME, TYPE, KEY)                                                        \
+    static int compare_pairs_##NAME(void *array_ptr, size_t first, size_t last) {                     \
+        TYPE *array = array_ptr;                                                                       \
+        int changed = 0;                                                                               \
+        for (size_t i = first; i < last; i += 2) {                                                     \
+            TYPE a = array[i];                                                                         \
+            TYPE b = array[i + 1];                                                                     \
+            int swap = KEY(b) < KEY(a);                                                                \
+            array[i] = swap ? b : a;                                                                   \
+            array[i + 1] = swap ? a : b;                                                               \
+            changed |= swap;                                                                           \
+        }                                                                                              \
+        return changed;                                                                                \
+    }                                                                                                  \
+                                                                                                       \
+    static void insertion_sort_##NAME(TYPE *array, size_t size) {                                      \
+        for (size_t i = 1; i < size; i++) {                                                            \
+            TYPE value = array[i];                                                                     \
+            size_t j = i;                                                                              \
+            while (j > 0 && KEY(value) < KEY(array[j - 1])) {                                          \
+                array[j] = array[j - 1];                                                               \
+                j--;                                                                                   \
+            }                                                                                          \
+            array[j] = value;                                                                          \
+        }                                                                                              \
+    }                                                                                                  \
+                                                                                                       \
+    static void sort_blocks_##NAME(void *array_ptr, size_t size) {                                     \
+        TYPE *array = array_ptr;                                                                       \
+        for (size_t i = 0; i < size; i += INSERTION_SORT_THRESHOLD) {                                  \
+            size_t len = size - i < INSERTION_SORT_THRESHOLD ? size - i : INSERTION_SORT_THRESHOLD;    \
+            insertion_sort_##NAME(array + i, len);                                                     \
+        }                                                                                              \
+    }                                                                                                  \
+                                                                                                       \
+    static void merge_runs_##NAME(const void *src_ptr, void *dst_ptr, size_t left, size_t mid,         \
+                                  size_t right) {                                                      \
+        const TYPE *src = src_ptr;                                                                     \
+        TYPE *dst = dst_ptr;                                                                           \
+        size_t i = left;                                                                               \
+        size_t j = mid;                                                                                \
+        size_t k = left;                                                                               \
+        while (i < mid && j < right) {                                                                 \
+            dst[k++] = (KEY(src[j]) < KEY(src[i])) ? src[j++] : src[i++];                              \
+        }                                                                                              \
+        while (i < mid) dst[k++] = src[i++];                                                           \
+        while (j < right) dst[k++] = src[j++];                                                         \
+    }                                                                                                  \
+                                                                                                       \
+    static void merge_split_low_##NAME(const void *low_ptr, size_t low_size, const void *high_ptr,    \
+                                       size_t high_size, void *out_ptr) {                              \
+        const TYPE *low = low_ptr;                                                                     \
+        const TYPE *high = high_ptr;                                                                   \
+        TYPE *out = out_ptr;                                                                           \
+        size_t i = 0;                                                                                  \
+        size_t j = 0;                                                                                  \
+        for (size_t k = 0; k < low_size; k++) {                                                        \
+            if (j >= high_size || (i < low_size && !(KEY(high[j]) < KEY(low[i])))) {                   \
+                out[k] = low[i++];                                                                     \
+            } else {                                                                                   \
+                out[k] = high[j++];                                                                    \
+            }                                                                                          \
+        }                                                                                              \
+    }                                                                                                  \
+                                                                                                       \
+    static void merge_split_high_##NAME(const void *low_ptr, size_t low_size, const void *high_ptr,   \
+                                        size_t high_size, void *out_ptr) {                             \
+        const TYPE *low = low_ptr;                                                                     \
+        const TYPE *high = high_ptr;                                                                   \
+        TYPE *out = out_ptr;                                                                           \
+        size_t i = low_size;                                                                           \
+        size_t j = high_size;                                                                          \
+        for (size_t k = high_size; k > 0; k--) {                                                       \
+            if (i == 0 || (j > 0 && !(KEY(high[j - 1]) < KEY(low[i - 1])))) {                          \
+                out[k - 1] = high[--j];                                                                \
+            } else {                                                                                   \
+                out[k - 1] = low[--i];                                                                 \
+            }                                                                                          \
+        }                                                                                              \
+    }                                                                                                  \
+                                                                                                       \
+    static int out_of_order_##NAME(const void *array_ptr, size_t i, size_t j) {                       \
+        const TYPE *array = array_ptr;                                                                 \
+        return KEY(array[j]) < KEY(array[i]);                                                          \
+    }                                                                                                  \
+                                                                                                       \
+    static size_t first_descent_##NAME(const void *array_ptr, size_t first, size_t last) {             \
+        const TYPE *array = array_ptr;                                                                 \
+        for (size_t i = first; i < last; i++) {                                                        \
+            if (KEY(array[i]) < KEY(array[i - 1])) {                                                   \
+                return i;                                                                              \
+            }                                                                                          \
+        }                                                                                              \
+        return last;                                                                                   \
+    }
+
+DEFINE_ELEMENT_KERNELS(int32, int32_t, SCALAR_KEY)
+DEFINE_ELEMENT_KERNELS(int64, int64_t, SCALAR_KEY)
+DEFINE_ELEMENT_KERNELS(kv, OddEvenKeyValue, KV_KEY)
+
+#define INT32_RADIX_KEY(x) ((uint32_t)(x) ^ UINT32_C(0x80000000))
+#define INT64_RADIX_KEY(x) ((uint64_t)(x) ^ (UINT64_C(1) << 63))
+#define KV_RADIX_KEY(x) ((x).key)
+
+/* Scatter goes through one cache-line buffer per bucket, so each of the 256 output streams is written
+   a full line at a time instead of one element at a time. */
+#define DEFINE_RADIX_KERNELS(NAME, TYPE, KEY)                                                          \
+    static void radix_count_##NAME(const void *array_ptr, size_t first, size_t last, unsigned shift,   \
+                                   size_t *count) {                                                    \
+        const TYPE *array = array_ptr;                                                                 \
+        for (size_t i = first; i < last; i++) {                                                        \
+            count[(KEY(array[i]) >> shift) & (RADIX_BUCKETS - 1)]++;                                   \
+        }                                                                                              \
+    }                                                                                                  \
+                                                                                                       \
+    static void radix_scatter_##NAME(const void *src_ptr, void *dst_ptr, size_t first, size_t last,    \
+                                     unsigned shift, size_t *offset) {                                 \
+        enum { WC = RADIX_WC_BYTES / sizeof(TYPE) };                                                   \
+        const TYPE *src = src_ptr;                                                                     \
+        TYPE *dst = dst_ptr;                                                                           \
+        _Alignas(RADIX_WC_BYTES) TYPE buffer[RADIX_BUCKETS][WC];                                       \
+        unsigned fill[RADIX_BUCKETS] = { 0 };                                                          \
+        for (size_t i = first; i < last; i++) {                                                        \
+            unsigned bucket = (unsigned)(KEY(src[i]) >> shift) & (RADIX_BUCKETS - 1);                  \
+            buffer[bucket][fill[bucket]++] = src[i];                                                   \
+            if (fill[bucket] == WC) {                                                                  \
+                memcpy(dst + offset[bucket], buffer[bucket], sizeof(buffer[bucket]));                  \
+                offset[bucket] += WC;                                                                  \
+                fill[bucket] = 0;                                                                      \
+            }                                                                                          \
+        }                                                                                              \
+        for (size_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {                                    \
+            memcpy(dst + offset[bucket], buffer[bucket], fill[bucket] * sizeof(TYPE));                 \
+            offset[bucket] += fill[bucket];                                                            \
+        }                                                                                              \
+    }
+
+DEFINE_RADIX_KERNELS(int32, int32_t, INT32_RADIX_KEY)
+DEFINE_RADIX_KERNELS(int64, int64_t, INT64_RADIX_KEY)
+DEFINE_RADIX_KERNELS(kv, OddEvenKeyValue, KV_RADIX_KEY)
+
+static void network_table_init(NetworkTable *table, size_t lanes) {
+    table->stages = 0;
+    for (size_t k = 2; k <= lanes; k *= 2) {
+        for (size_t j = k / 2; j > 0; j /= 2) {
+            size_t stage = table->stages++;
+            table->max_mask[stage] = 0;
+            for (size_t i = 0; i < lanes; i++) {
+                size_t partner = (j == k / 2) ? (i ^ (k - 1)) : (i ^ j);
+                table->partner[stage][i] = (int32_t)partner;
+                table->take_max[stage][i] = (i > partner) ? -1 : 0;
+                if (i > partner) table->max_mask[stage] |= 1u << i;
+            }
+        }
+    }
+}
+
+#if HAVE_X86_SIMD
+static NetworkTable sort8_table;
+static NetworkTable sort16_table;
+
+__attribute__((target("sse4.1")))
+static int compare_pairs_sse41(void *array_ptr, size_t first, size_t last) {
+    int32_t *array = array_ptr;
+    __m128i changed = _mm_setzero_si128();
+    size_t i = first;
+    for (; i + 3 <= last; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(array + i));
+        __m128i p = _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128i r = _mm_blend_epi16(_mm_min_epi32(v, p), _mm_max_epi32(v, p), 0xCC);
+        changed = _mm_or_si128(changed, _mm_xor_si128(r, v));
+        _mm_storeu_si128((__m128i *)(array + i), r);
+    }
+    return (!_mm_testz_si128(changed, changed)) | compare_pairs_int32(array, i, last);
+}
+
+__attribute__((target("avx2")))
+static int compare_pairs_avx2(void *array_ptr, size_t first, size_t last) {
+    int32_t *array = array_ptr;
+    __m256i changed = _mm256_setzero_si256();
+    size_t i = first;
+    for (; i + 7 <= last; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(array + i));
+        __m256i p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+        __m256i r = _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xAA);
+        changed = _mm256_or_si256(changed, _mm256_xor_si256(r, v));
+        _mm256_storeu_si256((__m256i *)(array + i), r);
+    }
+    return (!_mm256_testz_si256(changed, changed)) | compare_pairs_int32(array, i, last);
+}
+
+__attribute__((target("avx2")))
+static void sort_blocks_avx2(void *array_ptr, size_t size) {
+    int32_t *array = array_ptr;
+    __m256i partner[NETWORK_MAX_STAGES];
+    __m256i take_max[NETWORK_MAX_STAGES];
+    size_t stages = sort8_table.stages;
+    for (size_t s = 0; s < stages; s++) {
+        partner[s] = _mm256_loadu_si256((const __m256i *)sort8_table.partner[s]);
+        take_max[s] = _mm256_loadu_si256((const __m256i *)sort8_table.take_max[s]);
+    }
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(array + i));
+        for (size_t s = 0; s < stages; s++) {
+            __m256i p = _mm256_permutevar8x32_epi32(v, partner[s]);
+            v = _mm256_blendv_epi8(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), take_max[s]);
+        }
+        _mm256_storeu_si256((__m256i *)(array + i), v);
+    }
+    insertion_sort_int32(array + i, size - i);
+}
+
+__attribute__((target("avx512f")))
+static int compare_pairs_avx512(void *array_ptr, size_t first, size_t last) {
+    int32_t *array = array_ptr;
+    __mmask16 changed = 0;
+    size_t i = first;
+    for (; i + 15 <= last; i += 16) {
+        __m512i v = _mm512_loadu_si512(array + i);
+        __m512i p = _mm512_shuffle_epi32(v, _MM_PERM_CDAB);
+        __m512i r = _mm512_mask_blend_epi32(0xAAAA, _mm512_min_epi32(v, p), _mm512_max_epi32(v, p));
+        changed |= _mm512_cmpneq_epi32_mask(r, v);
+        _mm512_storeu_si512(array + i, r);
+    }
+    return (changed != 0) | compare_pairs_int32(array, i, last);
+}
+
+__attribute__((target("avx512f")))
+static void sort_blocks_avx512(void *array_ptr, size_t size) {
+    int32_t *array = array_ptr;
+    __m512i partner[NETWORK_MAX_STAGES];
+    __mmask16 max_mask[NETWORK_MAX_STAGES];
+    size_t stages = sort16_table.stages;
+    for (size_t s = 0; s < stages; s++) {
+        partner[s] = _mm512_loadu_si512(sort16_table.partner[s]);
+        max_mask[s] = (__mmask16)sort16_table.max_mask[s];
+    }
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m512i v = _mm512_loadu_si512(array + i);
+        for (size_t s = 0; s < stages; s++) {
+            __m512i p = _mm512_permutexvar_epi32(partner[s], v);
+            v = _mm512_mask_blend_epi32(max_mask[s], _mm512_min_epi32(v, p), _mm512_max_epi32(v, p));
+        }
+        _mm512_storeu_si512(array + i, v);
+    }
+    insertion_sort_int32(array + i, size - i);
+}
+#endif
+
+#define ELEMENT_KERNELS(NAME, TYPE, PAIRS, BLOCKS, WIDTH, SUFFIX)                                   \
+    { NAME, sizeof(TYPE), PAIRS, BLOCKS, WIDTH, merge_runs_##SUFFIX, merge_split_low_##SUFFIX,       \
+      merge_split_high_##SUFFIX, out_of_order_##SUFFIX, first_descent_##SUFFIX, radix_count_##SUFFIX, \
+      radix_scatter_##SUFFIX, 8 * (sizeof(TYPE) < sizeof(uint64_t) ? sizeof(TYPE) : sizeof(uint64_t)) }
+
+static const SimdKernels scalar_kernels =
+    ELEMENT_KERNELS("scalar", int32_t, compare_pairs_int32, sort_blocks_int32, INSERTION_SORT_THRESHOLD, int32);
+static const SimdKernels int64_kernels =
+    ELEMENT_KERNELS("int64", int64_t, compare_pairs_int64, sort_blocks_int64, INSERTION_SORT_THRESHOLD, int64);
+static const SimdKernels kv_kernels =
+    ELEMENT_KERNELS("kv", OddEvenKeyValue, compare_pairs_kv, sort_blocks_kv, INSERTION_SORT_THRESHOLD, kv);
+#if HAVE_X86_SIMD
+static const SimdKernels sse41_kernels =
+    ELEMENT_KERNELS("sse4.1", int32_t, compare_pairs_sse41, sort_blocks_int32, INSERTION_SORT_THRESHOLD, int32);
+static const SimdKernels avx2_kernels =
+    ELEMENT_KERNELS("avx2", int32_t, compare_pairs_avx2, sort_blocks_avx2, 8, int32);
+static const SimdKernels avx512_kernels =
+    ELEMENT_KERNELS("avx512", int32_t, compare_pairs_avx512, sort_blocks_avx512, 16, int32);
+#endif
+
+size_t oddeven_element_size(OddEvenType type) {
+    switch (type) {
+        case ODDEVEN_INT32:
+        case ODDEVEN_FLOAT: return sizeof(int32_t);
+        case ODDEVEN_KV: return sizeof(OddEvenKeyValue);
+        default: return sizeof(int64_t);
+    }
+}
+
+static const SimdKernels *select_kernels(OddEvenSimd level, OddEvenType type) {
+    if (oddeven_element_size(type) != sizeof(int32_t)) {
+        if (level != ODDEVEN_SIMD_AUTO && level != ODDEVEN_SIMD_SCALAR) return NULL;
+        return type == ODDEVEN_KV ? &kv_kernels : &int64_kernels;
+    }
+#if HAVE_X86_SIMD
+    __builtin_cpu_init();
+    bool has_sse41 = __builtin_cpu_supports("sse4.1");
+    bool has_avx2 = __builtin_cpu_supports("avx2");
+    bool has_avx512 = __builtin_cpu_supports("avx512f");
+    network_table_init(&sort8_table, 8);
+    network_table_init(&sort16_table, 16);
+    
+    if (level == ODDEVEN_SIMD_AUTO) {
+        if (has_avx512) return &avx512_kernels;
+        if (has_avx2) return &avx2_kernels;
+        if (has_sse41) return &sse41_kernels;
+        return &scalar_kernels;
+    }
+    if (level == ODDEVEN_SIMD_SSE41) return has_sse41 ? &sse41_kernels : NULL;
+    if (level == ODDEVEN_SIMD_AVX2) return has_avx2 ? &avx2_kernels : NULL;
+    if (level == ODDEVEN_SIMD_AVX512) return has_avx512 ? &avx512_kernels : NULL;
+    return &scalar_kernels;
+#else
+    return (level == ODDEVEN_SIMD_AUTO || level == ODDEVEN_SIMD_SCALAR) ? &scalar_kernels : NULL;
+#endif
+}
+
+static int run_phase(SortContext *ctx, size_t start, size_t end, size_t phase) {
+    size_t i;
+    if (phase % 2 == 0) {
+        i = (start % 2 == 0) ? start : start + 1;
+    } else {
+        i = (start % 2 == 1) ? start : start + 1;
+    }
+    size_t last = end < ctx->size - 1 ? end : ctx->size - 1;
+    if (i >= last) return 0;
+    return ctx->kernels->compare_pairs(ctx->array, i, last);
+}
+
+static int wait_for_release(SortContext *ctx) {
+    while (!atomic_load(&ctx->released)) {
+        thrd_yield();
+    }
+    return !atomic_load(&ctx->aborted);
+}
+
+static int worker_thread(void *arg) {
+    ThreadData *data = (ThreadData *)arg;
+    SortContext *ctx = data->ctx;
+    
+    if (!wait_for_release(ctx)) return 0;
+    
+    size_t last_phase = (size_t)-1;
+    
+    while (!atomic_load(&ctx->sorted)) {
+        size_t current_phase = atomic_load(&ctx->phase);
+        
+        if (current_phase != last_phase && current_phase < ctx->size) {
+            last_phase = current_phase;
+            atomic_fetch_add(&ctx->active_threads, 1);
+            
+            if (run_phase(ctx, data->start_index, data->end_index, current_phase)) {
+                atomic_store_explicit(&ctx->changed[current_phase % 3].value, 1, memory_order_relaxed);
+            }
+            
+            atomic_fetch_sub(&ctx->active_threads, 1);
+        }
+        
+        thrd_yield();
+    }
+    
+    return 0;
+}
+
+static int worker_thread_barrier(void *arg) {
+    ThreadData *data = (ThreadData *)arg;
+    SortContext *ctx = data->ctx;
+    
+    if (!wait_for_release(ctx)) return 0;
+    
+    bool sense = false;
+    size_t quiet_phases = 0;
+    
+    for (size_t phase = 0; phase < ctx->size; phase++) {
+        if (run_phase(ctx, data->start_index, data->end_index, phase)) {
+            atomic_store_explicit(&ctx->changed[phase % 3].value, 1, memory_order_relaxed);
+        }
+        if (data->index == 0) {
+            atomic_store_explicit(&ctx->changed[(phase + 1) % 3].value, 0, memory_order_relaxed);
+        }
+        
+        phase_barrier_wait(&ctx->barrier, &sense);
+        
+        if (atomic_load_explicit(&ctx->changed[phase % 3].value, memory_order_relaxed)) {
+            quiet_phases = 0;
+        } else if (++quiet_phases == 2) {
+            break;
+        }
+    }
+    
+    return 0;
+}
+
+static void merge_sort(void *array, void *scratch, size_t size, const SimdKernels *kernels) {
+    kernels->sort_blocks(array, size);
+    
+    void *src = array;
+    void *dst = scratch;
+    for (size_t width = kernels->block_width; width < size; width *= 2) {
+        for (size_t left = 0; left < size; left += 2 * width) {
+            size_t mid = left + width < size ? left + width : size;
+            size_t right = mid + width < size ? mid + width : size;
+            kernels->merge_runs(src, dst, left, mid, right);
+        }
+        void *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != array) {
+        memcpy(array, src, size * kernels->elem_size);
+    }
+}
+
+static bool range_sorted(const void *array, size_t size, const SimdKernels *kernels) {
+    return size < 2 || kernels->first_descent(array, 1, size) == size;
+}
+
+/* Index of the first of the sorted elements [first, last) that must go after array[key]. */
+static size_t upper_bound(const void *array, size_t first, size_t last, size_t key, const SimdKernels *kernels) {
+    while (first < last) {
+        size_t mid = first + (last - first) / 2;
+        if (kernels->out_of_order(array, mid, key)) {
+            last = mid;
+        } else {
+            first = mid + 1;
+        }
+    }
+    return first;
+}
+
+/* Index of the first of the sorted elements [first, last) that is not less than array[key]. */
+static size_t lower_bound(const void *array, size_t first, size_t last, size_t key, const SimdKernels *kernels) {
+    while (first < last) {
+        size_t mid = first + (last - first) / 2;
+        if (kernels->out_of_order(array, key, mid)) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+/* Merges the adjacent sorted runs [left, mid) and [mid, right) in place through scratch. Elements of
+   the left run not greater than array[mid] and of the right run not less than array[mid - 1] are
+   already in place, so only the overlap is merged; runs already in order cost one comparison. */
+static void merge_adjacent(void *array, void *scratch, size_t left, size_t mid, size_t right,
+                           const SimdKernels *kernels) {
+    if (!kernels->out_of_order(array, mid - 1, mid)) return;
+    left = upper_bound(array, left, mid, mid, kernels);
+    right = lower_bound(array, mid, right, mid - 1, kernels);
+    size_t elem_size = kernels->elem_size;
+    kernels->merge_runs(array, scratch, left, mid, right);
+    memcpy((char *)array + left * elem_size, (char *)scratch + left * elem_size, (right - left) * elem_size);
+}
+
+/* Natural merge sort for the adaptive mode: ascending runs of the input are kept as they are (runs
+   shorter than a block are extended to one and sorted by the block kernel) and merged on a stack
+   that keeps run lengths growing like Fibonacci numbers, as in Timsort. Sorted input is one run and
+   costs a single scan, a sorted array with k elements appended costs O(n + k log k), and the worst
+   case stays O(n log n). Equal keys keep their order. */
+static void natural_merge_sort(void *array, void *scratch, size_t size, const SimdKernels *kernels) {
+    size_t start[MERGE_STACK_DEPTH];
+    size_t length[MERGE_STACK_DEPTH];
+    size_t runs = 0;
+    size_t elem_size = kernels->elem_size;
+    for (size_t first = 0; first < size || runs > 1;) {
+        if (first < size) {
+            size_t last = kernels->first_descent(array, first + 1, size);
+            if (last - first < kernels->block_width && last < size) {
+                last = size - first < kernels->block_width ? size : first + kernels->block_width;
+                kernels->sort_blocks((char *)array + first * elem_size, last - first);
+            }
+            start[runs] = first;
+            length[runs++] = last - first;
+            first = last;
+        }
+        /* Restores length[i - 2] > length[i - 1] + length[i] and length[i - 1] > length[i]; after the
+           last run everything left on the stack is merged. */
+        while (runs > 1) {
+            size_t k = runs - 2;
+            if ((k >= 1 && length[k - 1] <= length[k] + length[k + 1]) ||
+                (k >= 2 && length[k - 2] <= length[k - 1] + length[k])) {
+                if (length[k - 1] < length[k + 1]) k--;
+            } else if (length[k] > length[k + 1] && first < size) {
+                break;
+            } else if (first == size && k >= 1 && length[k - 1] < length[k + 1]) {
+                k--;
+            }
+            merge_adjacent(array, scratch, start[k], start[k + 1], start[k + 1] + length[k + 1], kernels);
+            length[k] += length[k + 1];
+            for (size_t i = k + 1; i + 1 < runs; i++) {
+                start[i] = start[i + 1];
+                length[i] = length[i + 1];
+            }
+            runs--;
+        }
+    }
+}
+
+static void radix_offsets(size_t (*counts)[RADIX_BUCKETS], size_t thread_count, size_t index, size_t size,
+                          size_t *offset, bool *single_bucket) {
+    size_t total = 0;
+    *single_bucket = false;
+    for (size_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+        size_t sum = 0;
+        for (size_t t = 0; t < thread_count; t++) {
+            if (t == index) offset[bucket] = total + sum;
+            sum += counts[t][bucket];
+        }
+        if (sum == size) *single_bucket = true;
+        total += sum;
+    }
+}
+
+static void radix_sort(void *array, void *scratch, size_t size, const SimdKernels *kernels) {
+    size_t counts[1][RADIX_BUCKETS];
+    size_t offset[RADIX_BUCKETS];
+    void *src = array;
+    void *dst = scratch;
+    for (unsigned shift = 0; shift < kernels->key_bits; shift += RADIX_BITS) {
+        bool single_bucket;
+        memset(counts, 0, sizeof(counts));
+        kernels->radix_count(src, 0, size, shift, counts[0]);
+        radix_offsets(counts, 1, 0, size, offset, &single_bucket);
+        if (single_bucket) continue;
+        kernels->radix_scatter(src, dst, 0, size, shift, offset);
+        void *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != array) {
+        memcpy(array, src, size * kernels->elem_size);
+    }
+}
+
+/* Adaptive pre-check: each thread scans its range and the pair across its upper boundary, so the
+   whole array is checked in one parallel pass. Returns true on every thread if the array is sorted. */
+static bool check_presorted(SortContext *ctx, const ThreadData *data, bool *sense, bool *range_ordered) {
+    const SimdKernels *kernels = ctx->kernels;
+    size_t elem_size = kernels->elem_size;
+    *range_ordered = range_sorted((char *)ctx->array + data->start_index * elem_size,
+                                  data->end_index - data->start_index, kernels);
+    bool ordered = *range_ordered;
+    if (ordered && data->end_index < ctx->size) {
+        ordered = !kernels->out_of_order(ctx->array, data->end_index - 1, data->end_index);
+    }
+    if (!ordered) atomic_store_explicit(&ctx->unsorted.value, 1, memory_order_relaxed);
+    phase_barrier_wait(&ctx->barrier, sense);
+    return !atomic_load_explicit(&ctx->unsorted.value, memory_order_relaxed);
+}
+
+static int worker_thread_radix(void *arg) {
+    ThreadData *data = (ThreadData *)arg;
+    SortContext *ctx = data->ctx;
+    
+    if (!wait_for_release(ctx)) return 0;
+    
+    bool sense = false;
+    bool range_ordered;
+    if (ctx->adaptive && check_presorted(ctx, data, &sense, &range_ordered)) return 0;
+    
+    const SimdKernels *kernels = ctx->kernels;
+    size_t first = data->start_index;
+    size_t last = data->end_index;
+    size_t *count = ctx->radix_counts[data->index];
+    size_t offset[RADIX_BUCKETS];
+    void *src = ctx->array;
+    void *dst = ctx->scratch;
+    
+    for (unsigned shift = 0; shift < kernels->key_bits; shift += RADIX_BITS) {
+        bool single_bucket;
+        memset(count, 0, RADIX_BUCKETS * sizeof(size_t));
+        kernels->radix_count(src, first, last, shift, count);
+        phase_barrier_wait(&ctx->barrier, &sense);
+        
+        radix_offsets(ctx->radix_counts, ctx->thread_count, data->index, ctx->size, offset, &single_bucket);
+        if (!single_bucket) {
+            kernels->radix_scatter(src, dst, first, last, shift, offset);
+        }
+        phase_barrier_wait(&ctx->barrier, &sense);
+        
+        if (!single_bucket) {
+            void *tmp = src;
+            src = dst;
+            dst = tmp;
+        }
+    }
+    if (src != ctx->array) {
+        size_t elem_size = kernels->elem_size;
+        memcpy((char *)ctx->array + first * elem_size, (char *)src + first * elem_size, (last - first) * elem_size);
+    }
+    
+    return 0;
+}
+
+static int worker_thread_block(void *arg) {
+    ThreadData *data = (ThreadData *)arg;
+    SortContext *ctx = data->ctx;
+    
+    if (!wait_for_release(ctx)) return 0;
+    
+    size_t start = data->start_index;
+    size_t size = data->end_index - start;
+    const SimdKernels *kernels = ctx->kernels;
+    size_t elem_size = kernels->elem_size;
+    char *array = ctx->array;
+    char *block = array + start * elem_size;
+    char *scratch = (char *)ctx->scratch + start * elem_size;
+    bool sense = false;
+    bool range_ordered = false;
+    if (ctx->adaptive && check_presorted(ctx, data, &sense, &range_ordered)) return 0;
+    if (ctx->adaptive) {
+        if (!range_ordered) natural_merge_sort(block, scratch, size, kernels);
+    } else {
+        merge_sort(block, scratch, size, kernels);
+    }
+    
+    size_t quiet_rounds = 0;
+    phase_barrier_wait(&ctx->barrier, &sense);
+    
+    for (size_t round = 0; quiet_rounds < 2; round++) {
+        ThreadData *low = NULL;
+        ThreadData *high = NULL;
+        if (data->index % 2 == round % 2) {
+            if (data->index + 1 < ctx->thread_count) {
+                low = data;
+                high = &ctx->thread_data[data->index + 1];
+            }
+        } else if (data->index > 0) {
+            low = &ctx->thread_data[data->index - 1];
+            high = data;
+        }
+        
+        bool changed = false;
+        if (low != NULL && kernels->out_of_order(array, low->end_index - 1, high->start_index)) {
+            changed = true;
+            const char *low_block = array + low->start_index * elem_size;
+            const char *high_block = array + high->start_index * elem_size;
+            size_t low_size = low->end_index - low->start_index;
+            size_t high_size = high->end_index - high->start_index;
+            if (low == data) {
+                kernels->merge_split_low(low_block, low_size, high_block, high_size, scratch);
+            } else {
+                kernels->merge_split_high(low_block, low_size, high_block, high_size, scratch);
+            }
+            atomic_store_explicit(&ctx->changed[round % 3].value, 1, memory_order_relaxed);
+        }
+        if (data->index == 0) {
+            atomic_store_explicit(&ctx->changed[(round + 1) % 3].value, 0, memory_order_relaxed);
+        }
+        
+        phase_barrier_wait(&ctx->barrier, &sense);
+        
+        if (changed) {
+            memcpy(block, scratch, size * elem_size);
+        }
+        if (atomic_load_explicit(&ctx->changed[round % 3].value, memory_order_relaxed)) {
+            quiet_rounds = 0;
+        } else {
+            quiet_rounds++;
+        }
+        
+        phase_barrier_wait(&ctx->barrier, &sense);
+    }
+    
+    return 0;
+}
+
+static int worker_thread_touch(void *arg) {
+    ThreadData *data = (ThreadData *)arg;
+    SortContext *ctx = data->ctx;
+    size_t elem_size = ctx->kernels->elem_size;
+    size_t offset = data->start_index * elem_size;
+    size_t bytes = (data->end_index - data->start_index) * elem_size;
+    memset((char *)ctx->array + offset, 0, bytes);
+    if (ctx->scratch != NULL) memset((char *)ctx->scratch + offset, 0, bytes);
+    return 0;
+}
+
+static int thread_entry(void *arg) {
+    ThreadData *data = (ThreadData *)arg;
+    const CpuPlacement *placement = data->ctx->placement;
+    if (placement->count > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(placement->cpus[data->index % placement->count], &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            fprintf(stderr, "Warning: failed to pin thread %zu\n", data->index);
+        }
+    }
+    return data->run(data);
+}
+
+static int thread_start(const OddEvenThreads *threads, thrd_start_t run, ThreadData *data) {
+    data->run = run;
+    if (threads->start != NULL) {
+        return threads->start(threads->user, thread_entry, data, &data->handle);
+    }
+    return thrd_create(&data->thread, thread_entry, data) == thrd_success;
+}
+
+static void thread_join(const OddEvenThreads *threads, ThreadData *data) {
+    if (threads->start != NULL) {
+        threads->join(threads->user, data->handle);
+    } else {
+        thrd_join(data->thread, NULL);
+    }
+}
+
+static size_t parallel_thread_count(size_t size, size_t max_threads) {
+    size_t count = max_threads;
+    if (count > size / 2) count = size / 2;
+    if (count == 0) count = 1;
+    if (count > MAX_THREADS) count = MAX_THREADS;
+    return count;
+}
+
+/* Range boundaries fall on cache line boundaries of the array when the ranges are at least a line
+   long, so neighbouring threads share at most the line of the pair that crosses the boundary. */
+static void thread_range(ThreadData *data, const void *array, size_t size, size_t elem_size, size_t thread_count) {
+    size_t elements_per_thread = size / thread_count;
+    if (elements_per_thread == 0) elements_per_thread = 1;
+    size_t start = data->index * elements_per_thread;
+    size_t end = (data->index == thread_count - 1) ? size : (data->index + 1) * elements_per_thread;
+    
+    size_t line = CACHE_LINE / elem_size;
+    size_t misalignment = (uintptr_t)array % CACHE_LINE;
+    if (CACHE_LINE % elem_size == 0 && misalignment % elem_size == 0 && elements_per_thread >= 2 * line) {
+        size_t first_line = (CACHE_LINE - misalignment) % CACHE_LINE / elem_size;
+        if (data->index > 0) start = first_line + (start - first_line + line / 2) / line * line;
+        if (data->index < thread_count - 1) end = first_line + (end - first_line + line / 2) / line * line;
+    }
+    data->start_index = start;
+    data->end_index = end;
+}
+
+static int pool_worker(void *arg) {
+    ThreadData *data = (ThreadData *)arg;
+    WorkerPool *pool = data->pool;
+    
+    if (!wait_for_release(&pool->ctx)) return 0;
+    
+    bool sense = false;
+    for (;;) {
+        phase_barrier_wait(&pool->park, &sense);
+        thrd_start_t job = pool->job;
+        if (job == NULL) break;
+        if (data->index < pool->ctx.thread_count) job(data);
+        phase_barrier_wait(&pool->park, &sense);
+    }
+    
+    return 0;
+}
+
+/* Stops and joins the threads of a pool started by worker_pool_create. */
+static void worker_pool_destroy(WorkerPool *pool) {
+    if (pool == NULL) return;
+    pool->job = NULL;
+    phase_barrier_wait(&pool->park, &pool->park_sense);
+    for (size_t i = 0; i < pool->size; i++) {
+        thread_join(pool->threads, &pool->thread_data[i]);
+    }
+    phase_barrier_destroy(&pool->ctx.barrier);
+    phase_barrier_destroy(&pool->park);
+    free(pool->ctx.radix_counts);
+    free(pool);
+}
+
+/* Starts size threads pinned by placement once for the pool's lifetime; NULL if any of them
+   could not start. The counters of the radix engine are allocated for all of them up front. */
+static WorkerPool *worker_pool_create(size_t size, const OddEvenThreads *threads, const CpuPlacement *placement,
+                                      bool radix) {
+    WorkerPool *pool = aligned_alloc(CACHE_LINE, sizeof(WorkerPool));
+    if (pool == NULL) {
+        fprintf(stderr, "Error: failed to allocate sort threads\n");
+        return NULL;
+    }
+    memset(pool, 0, sizeof(WorkerPool));
+    pool->size = size;
+    pool->threads = threads;
+    pool->ctx.placement = placement;
+    atomic_init(&pool->ctx.released, 0);
+    atomic_init(&pool->ctx.aborted, 0);
+    
+    if (radix) {
+        pool->ctx.radix_counts = aligned_alloc(CACHE_LINE, size * sizeof(*pool->ctx.radix_counts));
+        if (pool->ctx.radix_counts == NULL) {
+            fprintf(stderr, "Error: failed to allocate radix counters\n");
+            free(pool);
+            return NULL;
+        }
+    }
+    if (!phase_barrier_init(&pool->park, size + 1, true)) {
+        fprintf(stderr, "Error: failed to initialize phase barrier\n");
+        free(pool->ctx.radix_counts);
+        free(pool);
+        return NULL;
+    }
+    if (!phase_barrier_init(&pool->ctx.barrier, size, true)) {
+        fprintf(stderr, "Error: failed to initialize phase barrier\n");
+        phase_barrier_destroy(&pool->park);
+        free(pool->ctx.radix_counts);
+        free(pool);
+        return NULL;
+    }
+    
+    for (size_t i = 0; i < size; i++) {
+        pool->thread_data[i].ctx = &pool->ctx;
+        pool->thread_data[i].pool = pool;
+        pool->thread_data[i].index = i;
+        if (!thread_start(threads, pool_worker, &pool->thread_data[i])) {
+            fprintf(stderr, "Error: failed to create thread %zu\n", i);
+            atomic_store(&pool->ctx.aborted, 1);
+            atomic_store(&pool->ctx.released, 1);
+            for (size_t j = 0; j < i; j++) {
+                thread_join(threads, &pool->thread_data[j]);
+            }
+            phase_barrier_destroy(&pool->ctx.barrier);
+            phase_barrier_destroy(&pool->park);
+            free(pool->ctx.radix_counts);
+            free(pool);
+            return NULL;
+        }
+    }
+    
+    atomic_store(&pool->ctx.released, 1);
+    return pool;
+}
+
+/* Runs job on the first ctx.thread_count threads of the pool; worker_pool_finish waits for them.
+   The calling thread may coordinate the job in between. */
+static void worker_pool_start(WorkerPool *pool, thrd_start_t job) {
+    pool->job = job;
+    phase_barrier_wait(&pool->park, &pool->park_sense);
+}
+
+static void worker_pool_finish(WorkerPool *pool) {
+    phase_barrier_wait(&pool->park, &pool->park_sense);
+}
+
+static int batcher_sort_parallel(WorkerPool *pool, void *array, void *scratch, size_t size, size_t thread_count,
+                                 OddEvenEngine engine, OddEvenSync sync, bool adaptive, const SimdKernels *kernels) {
+    if (engine != ODDEVEN_ENGINE_TRANSPOSITION && sync == ODDEVEN_SYNC_YIELD) {
+        sync = ODDEVEN_SYNC_SLEEP;
+    }
+    
+    SortContext *ctx = &pool->ctx;
+    ctx->array = array;
+    ctx->scratch = scratch;
+    ctx->size = size;
+    ctx->max_threads = thread_count;
+    ctx->sync = sync;
+    ctx->engine = engine;
+    ctx->adaptive = adaptive;
+    ctx->kernels = kernels;
+    atomic_store(&ctx->active_threads, 0);
+    atomic_store(&ctx->phase, 0);
+    atomic_store(&ctx->sorted, 0);
+    for (size_t i = 0; i < 3; i++) {
+        atomic_store(&ctx->changed[i].value, 0);
+    }
+    atomic_store(&ctx->unsorted.value, 0);
+    phase_barrier_reset(&ctx->barrier, thread_count, sync == ODDEVEN_SYNC_SLEEP);
+    
+    ctx->thread_data = pool->thread_data;
+    ctx->thread_count = thread_count;
+    for (size_t i = 0; i < thread_count; i++) {
+        thread_range(&pool->thread_data[i], array, size, kernels->elem_size, thread_count);
+    }
+    thrd_start_t worker = engine == ODDEVEN_ENGINE_RADIX ? worker_thread_radix : worker_thread_block;
+    if (engine == ODDEVEN_ENGINE_TRANSPOSITION) {
+        worker = (sync == ODDEVEN_SYNC_YIELD) ? worker_thread : worker_thread_barrier;
+    }
+    
+    worker_pool_start(pool, worker);
+    
+    /* Like the barrier workers, the coordinator stops after an even and an odd phase without swaps
+       instead of rescanning the whole array after every phase. */
+    if (sync == ODDEVEN_SYNC_YIELD) {
+        size_t max_phases = size;
+        size_t quiet_phases = 0;
+        for (size_t phase = 0; phase < max_phases; phase++) {
+            atomic_store_explicit(&ctx->changed[phase % 3].value, 0, memory_order_relaxed);
+            atomic_store(&ctx->phase, phase);
+            
+            while (atomic_load(&ctx->active_threads) < thread_count) {
+                thrd_yield();
+            }
+            
+            while (atomic_load(&ctx->active_threads) > 0) {
+                thrd_yield();
+            }
+            
+            if (atomic_load_explicit(&ctx->changed[phase % 3].value, memory_order_relaxed)) {
+                quiet_phases = 0;
+            } else if (++quiet_phases == 2) {
+                break;
+            }
+        }
+        
+        atomic_store(&ctx->sorted, 1);
+    }
+    
+    worker_pool_finish(pool);
+    return 1;
+}
+
+static void batcher_sort_sequential(void *array, void *scratch, size_t size, OddEvenEngine engine, bool adaptive,
+                                    const SimdKernels *kernels) {
+    if (size <= 1) return;
+    
+    if (engine == ODDEVEN_ENGINE_BLOCK) {
+        if (adaptive) {
+            natural_merge_sort(array, scratch, size, kernels);
+        } else {
+            merge_sort(array, scratch, size, kernels);
+        }
+        return;
+    }
+    if (engine == ODDEVEN_ENGINE_RADIX) {
+        if (adaptive && range_sorted(array, size, kernels)) return;
+        radix_sort(array, scratch, size, kernels);
+        return;
+    }
+    
+    size_t quiet_phases = 0;
+    for (size_t phase = 0; phase < size && quiet_phases < 2; phase++) {
+        size_t first = phase % 2;
+        if (first < size - 1 && kernels->compare_pairs(array, first, size - 1)) {
+            quiet_phases = 0;
+        } else {
+            quiet_phases++;
+        }
+    }
+}
+
+static size_t parse_cpu_list(const char *text, const cpu_set_t *allowed, cpu_set_t *seen, int *cpus, size_t count) {
+    while (*text) {
+        char *end;
+        long first = strtol(text, &end, 10);
+        if (end == text) break;
+        long last = first;
+        if (*end == '-') last = strtol(end + 1, &end, 10);
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            if (cpu < 0 || !CPU_ISSET(cpu, allowed) || CPU_ISSET(cpu, seen)) continue;
+            CPU_SET(cpu, seen);
+            cpus[count++] = (int)cpu;
+        }
+        if (*end != ',') break;
+        text = end + 1;
+    }
+    return count;
+}
+
+/* Orders the CPUs this process may run on by NUMA node from sysfs: compact fills one node before
+   the next, scatter deals them round-robin over the nodes. CPUs outside every listed node
+   (or all of them, without sysfs) form one extra node. */
+static void cpu_placement_init(CpuPlacement *placement, OddEvenAffinity affinity) {
+    placement->count = 0;
+    cpu_set_t allowed, seen;
+    if (affinity == ODDEVEN_AFFINITY_NONE || sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+    CPU_ZERO(&seen);
+    int *by_node = malloc(CPU_SETSIZE * sizeof(int));
+    if (by_node == NULL) return;
+    size_t node_start[MAX_NUMA_NODES + 2];
+    size_t nodes = 0;
+    size_t count = 0;
+    char path[64];
+    char line[1024];
+    for (int node = 0; node < MAX_NUMA_NODES; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *file = fopen(path, "r");
+        if (file == NULL) continue;
+        if (fgets(line, sizeof(line), file) != NULL) {
+            size_t added = parse_cpu_list(line, &allowed, &seen, by_node, count);
+            if (added > count) {
+                node_start[nodes++] = count;
+                count = added;
+            }
+        }
+        fclose(file);
+    }
+    size_t listed = count;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && !CPU_ISSET(cpu, &seen)) by_node[count++] = cpu;
+    }
+    if (count > listed) node_start[nodes++] = listed;
+    node_start[nodes] = count;
+    
+    if (affinity == ODDEVEN_AFFINITY_COMPACT) {
+        memcpy(placement->cpus, by_node, count * sizeof(int));
+    } else {
+        size_t placed = 0;
+        for (size_t j = 0; placed < count; j++) {
+            for (size_t node = 0; node < nodes; node++) {
+                if (node_start[node] + j < node_start[node + 1]) placement->cpus[placed++] = by_node[node_start[node] + j];
+            }
+        }
+    }
+    placement->count = count;
+    free(by_node);
+}
+
+int oddeven_buffer_alloc(OddEvenBuffer *buffer, size_t size, size_t elem_size, OddEvenAlloc mode) {
+    buffer->data = NULL;
+    buffer->size = size;
+    buffer->mapped_bytes = 0;
+    buffer->mode = mode;
+    
+    if (size > SIZE_MAX / elem_size) return 0;
+    size_t bytes = size * elem_size;
+    
+    if (mode == ODDEVEN_ALLOC_HEAP) {
+        buffer->data = malloc(bytes);
+        return buffer->data != NULL;
+    }
+    
+    if (mode == ODDEVEN_ALLOC_MMAP) {
+        void *mapped = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) return 0;
+        buffer->data = mapped;
+        buffer->mapped_bytes = bytes;
+        return 1;
+    }
+    
+    if (bytes > SIZE_MAX - 2 * HUGE_PAGE_SIZE) return 0;
+    size_t rounded = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    size_t reserved = rounded + HUGE_PAGE_SIZE;
+    char *mapped = mmap(NULL, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) return 0;
+    
+    uintptr_t address = (uintptr_t)mapped;
+    char *aligned = (char *)((address + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    size_t head = (size_t)(aligned - mapped);
+    if (head > 0) munmap(mapped, head);
+    if (reserved - head > rounded) munmap(aligned + rounded, reserved - head - rounded);
+    
+    if (madvise(aligned, rounded, MADV_HUGEPAGE) != 0) {
+        fprintf(stderr, "Warning: MADV_HUGEPAGE is not supported, using regular pages\n");
+    }
+    buffer->data = aligned;
+    buffer->mapped_bytes = rounded;
+    return 1;
+}
+
+int oddeven_buffer_map_file(OddEvenBuffer *buffer, const char *path, size_t elem_size, bool writable) {
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->mapped_bytes = 0;
+    buffer->mode = ODDEVEN_ALLOC_FILE;
+    
+    int fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot open '%s'\n", path);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (size_t)st.st_size % elem_size != 0) {
+        fprintf(stderr, "Error: '%s' is empty or its size is not a multiple of %zu bytes\n", path, elem_size);
+        close(fd);
+        return 0;
+    }
+    size_t bytes = (size_t)st.st_size;
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *mapped = mmap(NULL, bytes, prot, writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        fprintf(stderr, "Error: cannot map '%s'\n", path);
+        return 0;
+    }
+    buffer->data = mapped;
+    buffer->size = bytes / elem_size;
+    buffer->mapped_bytes = bytes;
+    return 1;
+}
+
+int oddeven_buffer_create_file(OddEvenBuffer *buffer, const char *path, size_t size, size_t elem_size) {
+    buffer->data = NULL;
+    buffer->size = size;
+    buffer->mapped_bytes = 0;
+    buffer->mode = ODDEVEN_ALLOC_FILE;
+    
+    if (size > SIZE_MAX / elem_size) return 0;
+    size_t bytes = size * elem_size;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)bytes) != 0) {
+        fprintf(stderr, "Error: cannot create '%s'\n", path);
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    void *mapped = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        fprintf(stderr, "Error: cannot map '%s'\n", path);
+        return 0;
+    }
+    buffer->data = mapped;
+    buffer->mapped_bytes = bytes;
+    return 1;
+}
+
+void oddeven_buffer_free(OddEvenBuffer *buffer) {
+    if (buffer->data == NULL) return;
+    if (buffer->mode == ODDEVEN_ALLOC_HEAP) {
+        free(buffer->data);
+    } else {
+        munmap(buffer->data, buffer->mapped_bytes);
+    }
+    buffer->data = NULL;
+}
+
+static void encode_keys(void *array, size_t size, OddEvenType type) {
+    for (size_t i = 0; i < size; i++) {
+        if (type == ODDEVEN_FLOAT) {
+            int32_t key;
+            memcpy(&key, (float *)array + i, sizeof(key));
+            ((int32_t *)array)[i] = key < 0 ? key ^ INT32_MAX : key;
+        } else if (type == ODDEVEN_DOUBLE) {
+            int64_t key;
+            memcpy(&key, (double *)array + i, sizeof(key));
+            ((int64_t *)array)[i] = key < 0 ? key ^ INT64_MAX : key;
+        } else if (type == ODDEVEN_UINT64) {
+            ((uint64_t *)array)[i] ^= UINT64_C(1) << 63;
+        }
+    }
+}
+
+static void decode_keys(void *array, size_t size, OddEvenType type) {
+    for (size_t i = 0; i < size; i++) {
+        if (type == ODDEVEN_FLOAT) {
+            int32_t key = ((int32_t *)array)[i];
+            key = key < 0 ? key ^ INT32_MAX : key;
+            memcpy((float *)array + i, &key, sizeof(key));
+        } else if (type == ODDEVEN_DOUBLE) {
+            int64_t key = ((int64_t *)array)[i];
+            key = key < 0 ? key ^ INT64_MAX : key;
+            memcpy((double *)array + i, &key, sizeof(key));
+        } else if (type == ODDEVEN_UINT64) {
+            ((uint64_t *)array)[i] ^= UINT64_C(1) << 63;
+        }
+    }
+}
+
+int oddeven_is_sorted(OddEvenType type, const void *array, size_t size) {
+    for (size_t i = 0; i + 1 < size; i++) {
+        int ordered;
+        switch (type) {
+            case ODDEVEN_INT32: ordered = ((const int32_t *)array)[i] <= ((const int32_t *)array)[i + 1]; break;
+            case ODDEVEN_INT64: ordered = ((const int64_t *)array)[i] <= ((const int64_t *)array)[i + 1]; break;
+            case ODDEVEN_UINT64: ordered = ((const uint64_t *)array)[i] <= ((const uint64_t *)array)[i + 1]; break;
+            case ODDEVEN_KV:
+                ordered = ((const OddEvenKeyValue *)array)[i].key <= ((const OddEvenKeyValue *)array)[i + 1].key;
+                break;
+            case ODDEVEN_FLOAT: {
+                int32_t keys[2];
+                memcpy(keys, (const float *)array + i, sizeof(keys));
+                encode_keys(keys, 2, ODDEVEN_FLOAT);
+                ordered = keys[0] <= keys[1];
+                break;
+            }
+            default: {
+                int64_t keys[2];
+                memcpy(keys, (const double *)array + i, sizeof(keys));
+                encode_keys(keys, 2, ODDEVEN_DOUBLE);
+                ordered = keys[0] <= keys[1];
+                break;
+            }
+        }
+        if (!ordered) return 0;
+    }
+    return 1;
+}
+
+void oddeven_options_init(OddEvenOptions *options) {
+    options->type = ODDEVEN_INT32;
+    options->engine = ODDEVEN_ENGINE_TRANSPOSITION;
+    options->sync = ODDEVEN_SYNC_SLEEP;
+    options->simd = ODDEVEN_SIMD_AUTO;
+    options->scratch_alloc = ODDEVEN_ALLOC_HEAP;
+    options->max_threads = 1;
+    options->threads = NULL;
+    options->affinity = ODDEVEN_AFFINITY_NONE;
+    options->adaptive = false;
+}
+
+OddEvenContext *oddeven_context_create(const OddEvenOptions *options) {
+    const SimdKernels *kernels = select_kernels(options->simd, options->type);
+    if (kernels == NULL) return NULL;
+    OddEvenContext *ctx = calloc(1, sizeof(OddEvenContext));
+    if (ctx == NULL) return NULL;
+    ctx->options = *options;
+    if (options->threads != NULL) ctx->threads = *options->threads;
+    ctx->kernels = kernels;
+    cpu_placement_init(&ctx->placement, options->affinity);
+    if (options->affinity != ODDEVEN_AFFINITY_NONE && ctx->placement.count == 0) {
+        fprintf(stderr, "Warning: CPU topology is unavailable, threads are not pinned\n");
+    }
+    return ctx;
+}
+
+void oddeven_context_destroy(OddEvenContext *ctx) {
+    if (ctx == NULL) return;
+    worker_pool_destroy(ctx->pool);
+    oddeven_buffer_free(&ctx->scratch);
+    free(ctx);
+}
+
+const char *oddeven_kernels_name(const OddEvenContext *ctx) {
+    return ctx->kernels->name;
+}
+
+static void *context_scratch(OddEvenContext *ctx, size_t size) {
+    if (ctx->options.engine == ODDEVEN_ENGINE_TRANSPOSITION) return NULL;
+    if (ctx->scratch.data != NULL && ctx->scratch.size >= size) return ctx->scratch.data;
+    oddeven_buffer_free(&ctx->scratch);
+    if (!oddeven_buffer_alloc(&ctx->scratch, size, ctx->kernels->elem_size, ctx->options.scratch_alloc)) {
+        fprintf(stderr, "Error: failed to allocate scratch of %zu elements\n", size);
+        ctx->scratch.data = NULL;
+        return NULL;
+    }
+    return ctx->scratch.data;
+}
+
+/* Sort threads of the context: started on first use for max_threads and restarted only when a
+   later call needs more of them, so repeated sorts do not create threads. */
+static WorkerPool *context_pool(OddEvenContext *ctx, size_t thread_count, size_t max_threads) {
+    if (ctx->pool != NULL && ctx->pool->size >= thread_count) return ctx->pool;
+    worker_pool_destroy(ctx->pool);
+    size_t size = max_threads < MAX_THREADS ? max_threads : MAX_THREADS;
+    ctx->pool = worker_pool_create(size, &ctx->threads, &ctx->placement,
+                                   ctx->options.engine == ODDEVEN_ENGINE_RADIX);
+    return ctx->pool;
+}
+
+int oddeven_sort_sequential(OddEvenContext *ctx, void *array, size_t size) {
+    void *scratch = context_scratch(ctx, size);
+    if (ctx->options.engine != ODDEVEN_ENGINE_TRANSPOSITION && scratch == NULL) return 0;
+    encode_keys(array, size, ctx->options.type);
+    batcher_sort_sequential(array, scratch, size, ctx->options.engine, ctx->options.adaptive, ctx->kernels);
+    decode_keys(array, size, ctx->options.type);
+    return 1;
+}
+
+int oddeven_sort_parallel(OddEvenContext *ctx, void *array, size_t size, size_t max_threads) {
+    if (size <= 1) return 1;
+    void *scratch = context_scratch(ctx, size);
+    if (ctx->options.engine != ODDEVEN_ENGINE_TRANSPOSITION && scratch == NULL) return 0;
+    size_t thread_count = parallel_thread_count(size, max_threads);
+    WorkerPool *pool = context_pool(ctx, thread_count, max_threads);
+    if (pool == NULL) return 0;
+    encode_keys(array, size, ctx->options.type);
+    int sorted = batcher_sort_parallel(pool, array, scratch, size, thread_count, ctx->options.engine,
+                                       ctx->options.sync, ctx->options.adaptive, ctx->kernels);
+    decode_keys(array, size, ctx->options.type);
+    return sorted;
+}
+
+int oddeven_first_touch(OddEvenContext *ctx, void *array, size_t size, size_t max_threads) {
+    if (size == 0) return 1;
+    void *scratch = context_scratch(ctx, size);
+    if (ctx->options.engine != ODDEVEN_ENGINE_TRANSPOSITION && scratch == NULL) return 0;
+    
+    size_t thread_count = parallel_thread_count(size, max_threads);
+    WorkerPool *pool = context_pool(ctx, thread_count, max_threads);
+    if (pool == NULL) {
+        /* Without the sort threads the ranges are still zeroed, only from this thread. */
+        SortContext touch;
+        touch.array = array;
+        touch.scratch = scratch;
+        touch.kernels = ctx->kernels;
+        ThreadData data;
+        data.ctx = &touch;
+        for (data.index = 0; data.index < thread_count; data.index++) {
+            thread_range(&data, array, size, ctx->kernels->elem_size, thread_count);
+            worker_thread_touch(&data);
+        }
+        return 0;
+    }
+    
+    pool->ctx.array = array;
+    pool->ctx.scratch = scratch;
+    pool->ctx.kernels = ctx->kernels;
+    pool->ctx.thread_count = thread_count;
+    for (size_t i = 0; i < thread_count; i++) {
+        thread_range(&pool->thread_data[i], array, size, ctx->kernels->elem_size, thread_count);
+    }
+    worker_pool_start(pool, worker_thread_touch);
+    worker_pool_finish(pool);
+    return 1;
+}
+
+int oddeven_sort(OddEvenContext *ctx, void *array, size_t size) {
+    if (ctx->options.max_threads <= 1) return oddeven_sort_sequential(ctx, array, size);
+    return oddeven_sort_parallel(ctx, array, size, ctx->options.max_threads);
+}
@@ -0,0 +1,190 @@
+#ifndef BATCHER_H
+#define BATCHER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Размер плитки по умолчанию */
+#define BATCHER_DEFAULT_TILE 65536
+
+/* Тип элементов массива */
+typedef enum {
+    BATCHER_INT32,
+    BATCHER_INT64,
+    BATCHER_UINT64,
+    BATCHER_FLOAT,
+    BATCHER_DOUBLE,
+    BATCHER_KV
+} batcher_type_t;
+/* Пара "64-битный ключ - 64-битный идентификатор", упорядочиваемая по ключу */
+typedef struct {
+    uint64_t key;
+    uint64_t id;
+} batcher_kv_t;
+/* Способ дополнения размера до степени двойки */
+typedef enum {
+    /* Элементы за концом массива считаются равными +бесконечности: пары с ними пропускаются */
+    BATCHER_PAD_VIRTUAL,
+    /* Массив копируется в буфер размера степени двойки, дополненный максимальным ключом */
+    BATCHER_PAD_PHYSICAL
+} batcher_pad_t;
+/* Алгоритм сортировки */
+typedef enum {
+    /* Выбор по размеру массива и числу потоков по откалиброванным порогам */
+    BATCHER_ENGINE_AUTO,
+    /* Сеть в одном потоке без пула: блок до ширины вектора сортируется целиком в регистре */
+    BATCHER_ENGINE_REGISTER,
+    /* Сеть Бетчера в пуле потоков */
+    BATCHER_ENGINE_NETWORK,
+    /* Поразрядная сортировка LSD по байтам ключа; устойчива */
+    BATCHER_ENGINE_RADIX
+} batcher_engine_t;
+/* Закрепление потоков пула за процессорами */
+typedef enum {
+    /* Размещение потоков оставляется планировщику */
+    BATCHER_AFFINITY_NONE,
+    /* Потоки занимают процессоры узла NUMA подряд и переходят к следующему узлу, когда он заполнен */
+    BATCHER_AFFINITY_COMPACT,
+    /* Соседние потоки закрепляются на разных узлах по кругу */
+    BATCHER_AFFINITY_SCATTER
+} batcher_affinity_t;
+/* Распределение проходов сети между потоками пула */
+typedef enum {
+    /* Проход делится на мелкие порции в очередях потоков; освободившийся поток забирает порции
+       у других, а стадии с достаточным числом блоков выполняются без барьеров между проходами */
+    BATCHER_SCHEDULE_STEAL,
+    /* Каждый поток получает одну равную долю прохода, после каждого прохода - барьер */
+    BATCHER_SCHEDULE_STATIC
+} batcher_schedule_t;
+/* Время одного прохода сети (p, k); для поблочного прохода k = 0, а p - размер блока;
+   для стадии p, выполненной блоками без барьеров между проходами, k = -1 */
+typedef struct {
+    long p;
+    long k;
+    double seconds;
+} batcher_pass_time_t;
+/* Замеры по монотонным часам в секундах, накапливаемые за все сортировки контекста.
+   Массивы busy и passes выделяет библиотека, освобождает batcher_stats_free */
+typedef struct {
+    /* Число потоков пула, включая вызывающий */
+    int threads;
+    /* Создание пула (при создании контекста), выполнение проходов и завершение потоков
+       (при уничтожении контекста) */
+    double spawn;
+    double compute;
+    double join;
+    /* Копирование в буфер физического дополнения и обратно */
+    double padding;
+    /* Перекодирование ключей до и после сортировки */
+    double codec;
+    /* Время, которое каждый поток провел в своих долях проходов (без ожидания на барьерах) */
+    double *busy;
+    /* Число захватов порций у других потоков */
+    long steals;
+    /* Число уже упорядоченных плиток и блоков 2p стадий, пропущенных адаптивным режимом */
+    long skipped;
+    batcher_pass_time_t *passes;
+    long pass_count;
+    long pass_capacity;
+} batcher_stats_t;
+/* Внешний исполнитель проходов вместо собственного пула: run должен вызвать task(arg, i)
+   для всех i из [0, count) и вернуться, когда все вызовы завершены. Вызовы независимы
+   и могут выполняться в любом порядке, в том числе в вызывающем потоке */
+typedef struct {
+    void *user;
+    /* Наибольшее число одновременных вызовов task */
+    int threads;
+    void (*run)(void *user, int count, void (*task)(void *arg, int index), void *arg);
+} batcher_executor_t;
+/* Параметры контекста */
+typedef struct {
+    batcher_type_t type;
+    /* Число потоков пула, включая вызывающий; не используется с внешним исполнителем */
+    int max_threads;
+    /* Размер плитки (округляется вниз до степени двойки) или 0, если плиточный режим выключен */
+    int tile;
+    batcher_pad_t pad;
+    /* Имя набора ядер ("scalar", "sse4.1", "avx2", "avx512") или NULL для лучшего доступного */
+    const char *kernels;
+    /* Замеры или NULL, если они не нужны */
+    batcher_stats_t *stats;
+    /* Исполнитель или NULL для собственного пула потоков */
+    const batcher_executor_t *executor;
+    batcher_engine_t engine;
+    /* Файл калибровки для BATCHER_ENGINE_AUTO или NULL для порогов по умолчанию. Если в файле нет
+       строки для набора ядер, размера элемента и числа потоков контекста, пороги измеряются
+       при создании контекста и дописываются в файл */
+    const char *calibration;
+    /* Закрепление потоков пула; вызывающий поток закрепляется до уничтожения контекста, которое
+       должно выполняться в нем же. Не используется с внешним исполнителем */
+    batcher_affinity_t affinity;
+    batcher_schedule_t schedule;
+    /* Адаптивный режим для почти отсортированных данных: отсортированный массив распознается
+       параллельной проверкой за один проход чтения, а сеть пропускает уже упорядоченные плитки
+       и блоки 2p стадий (обе половины блока отсортированы, и пара на их границе в порядке).
+       Результат тот же, худший случай - сеть плюс O(n) проверок */
+    bool adaptive;
+} batcher_options_t;
+/* Параметры внешней сортировки файла */
+typedef struct {
+    /* Бюджет памяти в байтах на буферы серий и слияния (по умолчанию 256 МиБ) */
+    size_t memory;
+    /* Каталог временных файлов или NULL для $TMPDIR, а без него - /tmp */
+    const char *temp_dir;
+} batcher_external_options_t;
+/* Замеры внешней сортировки */
+typedef struct {
+    /* Число отсортированных в памяти серий и проходов слияния (последний пишет выходной файл) */
+    long runs;
+    int merge_passes;
+    double run_seconds;
+    double merge_seconds;
+} batcher_external_stats_t;
+/* Контекст сортировки: пул потоков, выбранные ядра и буфер дополнения, переиспользуемые между сортировками */
+typedef struct batcher_context batcher_context_t;
+
+void batcher_options_init(batcher_options_t *options);
+/* Возвращает NULL, если набор ядер не поддерживается процессором или типом, либо не удалось создать пул */
+batcher_context_t *batcher_context_create(const batcher_options_t *options);
+void batcher_context_destroy(batcher_context_t *ctx);
+/* Сортировка n элементов типа контекста */
+void batcher_sort(batcher_context_t *ctx, void *array, long n);
+/* Заполнение нулями массива из n элементов и рабочих буферов его сортировки потоками пула, чтобы
+   их страницы оказались на узлах NUMA потоков, которые будут с ними работать. Точно совпадает с
+   долями потоков при BATCHER_SCHEDULE_STATIC; с захватом работы захваченные порции выполняются на
+   страницах чужих узлов. Вызывается для только что выделенной памяти до ее заполнения данными */
+void batcher_first_touch(batcher_context_t *ctx, void *array, long n);
+const char *batcher_kernels_name(const batcher_context_t *ctx);
+batcher_type_t batcher_context_type(const batcher_context_t *ctx);
+int batcher_tile_size(const batcher_context_t *ctx);
+/* Алгоритм, которым контекст отсортирует n элементов */
+batcher_engine_t batcher_select_engine(const batcher_context_t *ctx, long n);
+const char *batcher_engine_name(batcher_engine_t engine);
+/* Пороги выбора: до register_max элементов - сеть в одном потоке, от radix_min (если не 0) - радикс */
+void batcher_thresholds(const batcher_context_t *ctx, long *register_max, long *radix_min);
+/* Имена наборов ядер для int32, поддерживаемых процессором; возвращает их количество (не больше max) */
+int batcher_supported_kernels(const char **names, int max);
+
+bool batcher_is_sorted(batcher_type_t type, const void *array, long n);
+size_t batcher_type_size(batcher_type_t type);
+void batcher_stats_free(batcher_stats_t *stats);
+
+void batcher_external_options_init(batcher_external_options_t *options);
+/* Внешняя сортировка файла из элементов типа контекста, который может не помещаться в память:
+   серии размером в четверть бюджета сортируются контекстом и пишутся во временный файл, затем
+   сливаются деревом проигравших, при необходимости в несколько проходов. Чтение и запись идут
+   асинхронно, параллельно с сортировкой и слиянием. output может совпадать с input.
+   stats может быть NULL. Возвращает false при ошибке ввода-вывода или памяти */
+bool batcher_sort_file(batcher_context_t *ctx, const char *input, const char *output,
+                       const batcher_external_options_t *options, batcher_external_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1627 @@
+#define _GNU_SOURCE
+#include "batcher.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+#define BUF_SIZE 256
+/* Максимальное число 32-битных элементов в векторном регистре (AVX-512) */
+#define SIMD_MAX_LANES 16
+/* Число стадий битонической сети для сортировки 16 элементов в регистре */
+#define SIMD_MAX_STAGES 10
+/* Разрядность и число корзин одного прохода поразрядной сортировки */
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+/* Размер буфера записи одной корзины при раскладке (строка кэша) */
+#define RADIX_WC_BYTES 64
+/* Пороги выбора алгоритма без калибровки */
+#define DEFAULT_REGISTER_MAX 2048
+#define DEFAULT_RADIX_MIN 65536
+/* Наибольший размер массива при калибровке */
+#define CALIBRATION_MAX_N (1L << 20)
+/* Наибольшее число узлов NUMA, которые ищутся в sysfs */
+#define MAX_NUMA_NODES 64
+/* Размер страницы, на границах которой делится массив при первом касании */
+#define TOUCH_PAGE_BYTES 4096
+/* Число порций прохода на поток при захвате работы: чем больше, тем мельче единица захвата */
+#define STEAL_CHUNKS_PER_THREAD 8
+/* Стадия выполняется блоками без барьеров между проходами, если блоков не меньше этого числа на поток */
+#define STAGE_BLOCKS_PER_THREAD 2
+/* Единица доли потока при адаптивной проверке упорядоченности массива */
+#define CHECK_UNIT 4096
+
+static void print_stderr(const char *str) {
+    write(STDERR_FILENO, str, strlen(str));
+}
+/* Ядро сравнения-обмена двух подряд идущих блоков: lo[i] <-> hi[i] для i из [0, len) */
+typedef void (*block_kernel_t)(void *lo, void *hi, long len);
+/* Ядро прохода (p, k) с малым расстоянием k < lanes для рангов пар [r0, r1) */
+typedef void (*small_pass_kernel_t)(int *array, long n, long p, long k, long r0, long r1);
+/* Ядро сортировки выровненных блоков по lanes элементов в регистре */
+typedef void (*sort_blocks_kernel_t)(int *array, long n);
+/* Ядро подсчета элементов [r0, r1) по корзинам байта ключа со сдвигом shift */
+typedef void (*radix_count_kernel_t)(const void *array, long r0, long r1, unsigned shift, long *count);
+/* Ядро раскладки элементов [r0, r1) из src в dst по начальным позициям корзин offset */
+typedef void (*radix_scatter_kernel_t)(const void *src, void *dst, long r0, long r1, unsigned shift, long *offset);
+/* Ядро поиска первого i из [r0, r1) с array[i] < array[i - 1] (r0 >= 1); r1, если такого нет */
+typedef long (*descent_kernel_t)(const void *array, long r0, long r1);
+/* Набор ядер для одного типа элементов, выбираемый один раз по типу и возможностям процессора.
+   Ядра вызываются на целый проход или блок, поэтому внутренний цикл специализирован под тип
+   и не вызывает компаратор через указатель на каждое сравнение */
+typedef struct {
+    const char *name;
+    size_t elem_size;
+    /* Ширина вектора в элементах; 1 - без сортировки в регистре */
+    int lanes;
+    block_kernel_t compare_blocks;
+    /* Скалярное ядро для коротких блоков */
+    block_kernel_t compare_small;
+    small_pass_kernel_t small_pass;
+    sort_blocks_kernel_t sort_blocks;
+    /* Значение +бесконечности для физического дополнения */
+    const void *pad_value;
+    /* Ядра поразрядной сортировки и разрядность ключа */
+    radix_count_kernel_t radix_count;
+    radix_scatter_kernel_t radix_scatter;
+    unsigned key_bits;
+    descent_kernel_t first_descent;
+} simd_kernels_t;
+/* Таблица перестановки: номер парного элемента и флаг "взять максимум" для каждой позиции */
+typedef struct {
+    int32_t partner[SIMD_MAX_LANES];
+    int32_t take_max[SIMD_MAX_LANES];
+    uint32_t max_mask;
+} lane_table_t;
+/* Буфер для физического дополнения, переиспользуемый между сортировками */
+typedef struct {
+    void *data;
+    size_t capacity;
+} pad_pool_t;
+/* Параметры сортировки */
+typedef struct {
+    int max_threads;
+    /* Размер плитки (степень двойки) или 0, если плиточный режим выключен */
+    int tile;
+    batcher_pad_t pad;
+    batcher_schedule_t schedule;
+    const simd_kernels_t *kernels;
+    /* Замеры сортировки или NULL, если они не нужны */
+    batcher_stats_t *stats;
+} sort_config_t;
+/* Структура для хранения данных о сортировке */
+typedef struct {
+    void *array;
+    long n;
+    const simd_kernels_t *kernels;
+    batcher_stats_t *stats;
+    /* Счетчики корзин поразрядной сортировки, по строке на поток пула */
+    long (*radix_counts)[RADIX_BUCKETS];
+    /* Адаптивный режим: уже упорядоченные плитки и блоки 2p стадий пропускаются */
+    bool adaptive;
+    /* Блоки 2p текущей стадии, упорядоченные до ее начала (1 - блок пропускается), или NULL */
+    const uint8_t *ordered;
+    /* Признак нарушения порядка, найденного проходом проверки */
+    _Atomic bool unsorted;
+} sort_data_t;
+/* Вид прохода: сеть, целая стадия сети блоками, шаги поразрядной сортировки, первое касание буфера
+   или проверка упорядоченности массива */
+typedef enum {
+    PASS_NETWORK,
+    PASS_STAGE,
+    PASS_RADIX_COUNT,
+    PASS_RADIX_SCATTER,
+    PASS_TOUCH,
+    PASS_CHECK
+} pass_kind_t;
+/* Описание одного прохода сети. Для прохода (p, k) сравниваются пары (a, a + k);
+   пары нумеруются рангами, и каждый поток получает chunk подряд идущих рангов.
+   Для локального прохода (local > 0) поток получает chunk выровненных блоков
+   по local элементов и полностью сортирует каждый из них. В проходах поразрядной
+   сортировки поток получает chunk подряд идущих элементов src, при первом касании -
+   chunk подряд идущих элементов dst. В проходе стадии единица работы - блок 2p элементов,
+   в котором выполняются все проходы (p, k) стадии. При захвате работы (steal) проход
+   делится на chunks порций по chunk единиц, которые потоки берут из очередей друг друга */
+typedef struct {
+    long p;
+    long k;
+    long total;
+    long chunk;
+    long local;
+    pass_kind_t kind;
+    unsigned shift;
+    const void *src;
+    void *dst;
+    bool steal;
+    long chunks;
+    /* Число потоков, между очередями которых распределены порции прохода */
+    int workers;
+} pass_desc_t;
+/* Очередь порций потока: непрерывный диапазон номеров [head, tail), упакованный в одно слово
+   (head в старших 32 битах). Владелец берет порции с начала, другие потоки забирают половину
+   с конца; обе операции - сравнение с обменом всего слова. Очередь занимает строку кэша */
+typedef struct {
+    _Alignas(64) _Atomic uint64_t range;
+} steal_deque_t;
+/* Пул потоков, создаваемый один раз на весь контекст */
+typedef struct thread_pool thread_pool_t;
+/* Структура для хранения данных о потоке */
+typedef struct {
+    thread_pool_t *pool;
+    int index;
+} thread_data_t;
+
+struct thread_pool {
+    sort_data_t *data;
+    pthread_t *threads;
+    thread_data_t *tdata;
+    /* Число потоков пула, включая вызывающий поток */
+    int size;
+    /* Внешний исполнитель, которому передаются проходы вместо собственных потоков, или NULL */
+    const batcher_executor_t *executor;
+    /* Захват работы в проходах сети и очереди порций, по одной на поток пула */
+    bool steal;
+    steal_deque_t *deques;
+    /* Процессоры, на которых закрепляются потоки (поток t - на cpus[t % cpu_count]), или 0 */
+    const int *cpus;
+    int cpu_count;
+    /* Исходная маска вызывающего потока, восстанавливаемая при уничтожении пула */
+    cpu_set_t caller_cpus;
+    bool caller_pinned;
+    pass_desc_t pass;
+    bool shutdown;
+    /* Флаг готовности пула, по которому созданные потоки начинают работу */
+    bool started;
+    /* Признак ошибки создания барьеров: потоки завершаются, не дожидаясь проходов */
+    bool failed;
+    pthread_mutex_t start_mutex;
+    pthread_cond_t start_cond;
+    /* Барьеры начала и конца прохода, на которых потоки ждут между проходами */
+    pthread_barrier_t start_barrier;
+    pthread_barrier_t done_barrier;
+};
+
+struct batcher_context {
+    batcher_type_t type;
+    batcher_engine_t engine;
+    /* Пороги выбора алгоритма для BATCHER_ENGINE_AUTO; radix_min = 0 - радикс не выбирается */
+    long register_max;
+    long radix_min;
+    sort_config_t config;
+    sort_data_t data;
+    thread_pool_t pool;
+    pad_pool_t pad_pool;
+    /* Второй буфер поразрядной сортировки, между проходами которой буферы меняются ролями */
+    pad_pool_t radix_pool;
+    /* Отметки упорядоченных блоков стадии в адаптивном режиме */
+    pad_pool_t ordered_pool;
+    /* Порядок процессоров для закрепления потоков пула */
+    int *cpus;
+};
+/* Ключи, по которым сравниваются элементы */
+#define SCALAR_KEY(x) (x)
+#define PAIR_KEY(x) ((x).key)
+/* Функции сравнения-обмена блоков и проверки порядка для типа TYPE с ключом KEY.
+   Обмен выполняется без ветвлений (min/max), поэтому компилятор векторизует цикл */
+#define DEFINE_TYPED_KERNELS(NAME, TYPE, KEY)                                   \
+    static void compare_blocks_##NAME(void *lo_ptr, void *hi_ptr, long len) {   \
+        TYPE *lo = (TYPE *)lo_ptr;                                              \
+        TYPE *hi = (TYPE *)hi_ptr;                                              \
+        for (long i = 0; i < len; i++) {                                        \
+            TYPE a = lo[i];                                                     \
+            TYPE b = hi[i];                                                     \
+            bool swap = KEY(b) < KEY(a);                                        \
+            lo[i] = swap ? b : a;                                               \
+            hi[i] = swap ? a : b;                                               \
+        }                                                                       \
+    }                                                                           \
+    static bool is_sorted_##NAME(const void *array_ptr, long n) {               \
+        const TYPE *array = (const TYPE *)array_ptr;                            \
+        for (long i = 1; i < n; i++) {                                          \
+            if (KEY(array[i]) < KEY(array[i - 1])) {                            \
+                return false;                                                   \
+            }                                                                   \
+        }                                                                       \
+        return true;                                                            \
+    }                                                                           \
+    static long first_descent_##NAME(const void *array_ptr, long r0, long r1) { \
+        const TYPE *array = (const TYPE *)array_ptr;                            \
+        for (long i = r0; i < r1; i++) {                                        \
+            if (KEY(array[i]) < KEY(array[i - 1])) {                            \
+                return i;                                                       \
+            }                                                                   \
+        }                                                                       \
+        return r1;                                                              \
+    }
+
+DEFINE_TYPED_KERNELS(int32, int32_t, SCALAR_KEY)
+DEFINE_TYPED_KERNELS(int64, int64_t, SCALAR_KEY)
+DEFINE_TYPED_KERNELS(pair, batcher_kv_t, PAIR_KEY)
+
+/* Ядра поразрядной сортировки LSD для типа TYPE. Ключ UKEY переводится в беззнаковый с тем же
+   порядком (у знаковых инвертируется старший бит). При раскладке элементы каждой корзины сначала
+   копируются в свой буфер размером со строку кэша и выписываются в dst целыми буферами: поток
+   пишет в 256 разных мест, и запись по одному элементу промахивалась бы мимо кэша и TLB */
+#define DEFINE_RADIX_KERNELS(NAME, TYPE, UKEY)                                  \
+    static void radix_count_##NAME(const void *array_ptr, long r0, long r1, unsigned shift, long *count) { \
+        const TYPE *array = (const TYPE *)array_ptr;                            \
+        for (long i = r0; i < r1; i++) {                                        \
+            count[(UKEY(array[i]) >> shift) & (RADIX_BUCKETS - 1)]++;           \
+        }                                                                       \
+    }                                                                           \
+    static void radix_scatter_##NAME(const void *src_ptr, void *dst_ptr, long r0, long r1, unsigned shift, \
+                                     long *offset) {                            \
+        enum { WC = RADIX_WC_BYTES / sizeof(TYPE) };                            \
+        const TYPE *src = (const TYPE *)src_ptr;                                \
+        TYPE *dst = (TYPE *)dst_ptr;                                            \
+        _Alignas(RADIX_WC_BYTES) TYPE buffer[RADIX_BUCKETS][WC];                \
+        int fill[RADIX_BUCKETS] = { 0 };                                        \
+        for (long i = r0; i < r1; i++) {                                        \
+            unsigned b = (unsigned)(UKEY(src[i]) >> shift) & (RADIX_BUCKETS - 1); \
+            buffer[b][fill[b]++] = src[i];                                      \
+            if (fill[b] == WC) {                                                \
+                memcpy(dst + offset[b], buffer[b], sizeof(buffer[b]));          \
+                offset[b] += WC;                                                \
+                fill[b] = 0;                                                    \
+            }                                                                   \
+        }                                                                       \
+        for (int b = 0; b < RADIX_BUCKETS; b++) {                               \
+            memcpy(dst + offset[b], buffer[b], (size_t)fill[b] * sizeof(TYPE)); \
+            offset[b] += fill[b];                                               \
+        }                                                                       \
+    }
+
+#define INT32_UKEY(x) ((uint32_t)(x) ^ UINT32_C(0x80000000))
+#define INT64_UKEY(x) ((uint64_t)(x) ^ (UINT64_C(1) << 63))
+#define PAIR_UKEY(x) ((x).key)
+
+DEFINE_RADIX_KERNELS(int32, int32_t, INT32_UKEY)
+DEFINE_RADIX_KERNELS(int64, int64_t, INT64_UKEY)
+DEFINE_RADIX_KERNELS(pair, batcher_kv_t, PAIR_UKEY)
+
+static const int32_t pad_int32 = INT32_MAX;
+static const int64_t pad_int64 = INT64_MAX;
+static const batcher_kv_t pad_pair = { UINT64_MAX, UINT64_MAX };
+/* Функция для выполнения пар прохода (p, k) с рангами [r0, r1).
+   Пары прохода сгруппированы: в группе k нижних элементов [base, base + k)
+   сравниваются с k верхними [base + k, base + 2k). При k == p группы начинаются
+   с кратных 2k, иначе со сдвигом k, и группа, пересекающая границу блока 2p,
+   пропускается. Пары с верхним элементом за концом массива пропускаются:
+   это и есть виртуальное дополнение значениями +бесконечность */
+static void merge_pass_ranks(const simd_kernels_t *kernels, void *array, long n, long p, long k, long r0, long r1) {
+    char *bytes = (char *)array;
+    size_t size = kernels->elem_size;
+    long offset = (k == p) ? 0 : k;
+    while (r0 < r1) {
+        long group = r0 / k;
+        long i = r0 % k;
+        long base = offset + group * 2 * k;
+        long len = k - i;
+        if (len > r1 - r0) len = r1 - r0;
+        r0 += len;
+        if (k < p && (base + k) % (2 * p) == 0) continue;
+        long lo = base + i;
+        long hi = lo + k;
+        if (hi >= n) break;
+        if (hi + len > n) len = n - hi;
+        if (len >= 8) {
+            kernels->compare_blocks(bytes + lo * size, bytes + hi * size, len);
+        } else {
+            kernels->compare_small(bytes + lo * size, bytes + hi * size, len);
+        }
+    }
+}
+/* Число рангов пар в проходе (p, k): k на каждую группу, у которой есть верхний элемент */
+static long merge_pass_total(long n, long p, long k) {
+    long offset = (k == p) ? 0 : k;
+    if (n - k - offset <= 0) return 0;
+    return (n - k - offset + 2 * k - 1) / (2 * k) * k;
+}
+/* Функция для вставки, которой досортировывается неполный последний блок */
+static void insertion_sort(int *array, long n) {
+    for (long i = 1; i < n; i++) {
+        int value = array[i];
+        long j = i;
+        while (j > 0 && array[j - 1] > value) {
+            array[j] = array[j - 1];
+            j--;
+        }
+        array[j] = value;
+    }
+}
+/* Функция для полной сортировки блока сетью: все стадии с блоками 2p <= n.
+   Выход сети - отсортированный блок, поэтому стадии 2p <= lanes заменяются
+   сортировкой в регистре; результат от этого не меняется */
+static void local_sort(const simd_kernels_t *kernels, void *array, long n) {
+    long p = 1;
+    if (kernels->lanes > 1) {
+        kernels->sort_blocks(array, n);
+        p = kernels->lanes;
+    }
+    for (; p < n; p *= 2) {
+        for (long k = p; k >= 1; k /= 2) {
+            long total = merge_pass_total(n, p, k);
+            if (k < kernels->lanes) {
+                kernels->small_pass(array, n, p, k, 0, total);
+            } else {
+                merge_pass_ranks(kernels, array, n, p, k, 0, total);
+            }
+        }
+    }
+}
+
+/* Скалярный набор для int, которым векторные ядра обрабатывают хвосты */
+static const simd_kernels_t scalar_kernels;
+
+#if HAVE_X86_SIMD
+/* Таблицы сортировки блока в регистре (битоническая сеть) для 8 и 16 элементов;
+   любая сортирующая сеть дает тот же отсортированный блок */
+static lane_table_t sort8_tables[SIMD_MAX_STAGES];
+static lane_table_t sort16_tables[SIMD_MAX_STAGES];
+static int sort8_stages;
+static int sort16_stages;
+/* Таблицы проходов k < lanes со сдвигом k: позиция l сравнивается с l ^ k.
+   Во втором варианте последняя группа вектора исключена (она пересекает границу блока 2p) */
+static lane_table_t shift8_tables[3][2];
+static lane_table_t shift16_tables[4][2];
+
+static void lane_table_set(lane_table_t *table, int lane, int partner) {
+    table->partner[lane] = partner;
+    table->take_max[lane] = lane > partner ? -1 : 0;
+    if (lane > partner) table->max_mask |= 1u << lane;
+}
+
+static int sort_tables_init(lane_table_t *tables, int lanes) {
+    int stages = 0;
+    for (int k = 2; k <= lanes; k *= 2) {
+        for (int j = k / 2; j > 0; j /= 2) {
+            lane_table_t *table = &tables[stages++];
+            table->max_mask = 0;
+            for (int i = 0; i < lanes; i++) {
+                lane_table_set(table, i, (j == k / 2) ? (i ^ (k - 1)) : (i ^ j));
+            }
+        }
+    }
+    return stages;
+}
+
+static void shift_tables_init(lane_table_t (*tables)[2], int lanes) {
+    for (int t = 0; (1 << t) < lanes; t++) {
+        int k = 1 << t;
+        for (int excluded = 0; excluded < 2; excluded++) {
+            lane_table_t *table = &tables[t][excluded];
+            table->max_mask = 0;
+            for (int i = 0; i < lanes; i++) {
+                /* Исключенные позиции ссылаются сами на себя: min(v, v) = max(v, v) = v */
+                bool skip = excluded && i >= lanes - 2 * k;
+                lane_table_set(table, i, skip ? i : (i ^ k));
+            }
+        }
+    }
+}
+
+static void lane_tables_init(void) {
+    sort8_stages = sort_tables_init(sort8_tables, 8);
+    sort16_stages = sort_tables_init(sort16_tables, 16);
+    shift_tables_init(shift8_tables, 8);
+    shift_tables_init(shift16_tables, 16);
+}
+/* Номер таблицы сдвига для k = 1, 2, 4, 8 */
+static int shift_table_index(long k) {
+    int t = 0;
+    while ((1L << t) < k) t++;
+    return t;
+}
+
+__attribute__((target("sse4.1")))
+static void compare_blocks_sse41(void *lo_ptr, void *hi_ptr, long len) {
+    int *lo = (int *)lo_ptr;
+    int *hi = (int *)hi_ptr;
+    long i = 0;
+    for (; i + 4 <= len; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(lo + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(hi + i));
+        _mm_storeu_si128((__m128i *)(lo + i), _mm_min_epi32(a, b));
+        _mm_storeu_si128((__m128i *)(hi + i), _mm_max_epi32(a, b));
+    }
+    compare_blocks_int32(lo + i, hi + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void compare_blocks_avx2(void *lo_ptr, void *hi_ptr, long len) {
+    int *lo = (int *)lo_ptr;
+    int *hi = (int *)hi_ptr;
+    long i = 0;
+    for (; i + 8 <= len; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(lo + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(hi + i));
+        _mm256_storeu_si256((__m256i *)(lo + i), _mm256_min_epi32(a, b));
+        _mm256_storeu_si256((__m256i *)(hi + i), _mm256_max_epi32(a, b));
+    }
+    compare_blocks_int32(lo + i, hi + i, len - i);
+}
+/* Проход с k < 8: вектор из 8 элементов, начинающийся с base = k + 2r, содержит 8 / 2k целых групп */
+__attribute__((target("avx2")))
+static void small_pass_avx2(int *array, long n, long p, long k, long r0, long r1) {
+    const lane_table_t *tables = shift8_tables[shift_table_index(k)];
+    __m256i partner[2];
+    __m256i take_max[2];
+    for (int e = 0; e < 2; e++) {
+        partner[e] = _mm256_loadu_si256((const __m256i *)tables[e].partner);
+        take_max[e] = _mm256_loadu_si256((const __m256i *)tables[e].take_max);
+    }
+    long r = r0;
+    for (; r + 4 <= r1; r += 4) {
+        long base = k + 2 * r;
+        if (base + 8 > n) break;
+        int e = (base + 8 - k) % (2 * p) == 0;
+        __m256i v = _mm256_loadu_si256((const __m256i *)(array + base));
+        __m256i w = _mm256_permutevar8x32_epi32(v, partner[e]);
+        v = _mm256_blendv_epi8(_mm256_min_epi32(v, w), _mm256_max_epi32(v, w), take_max[e]);
+        _mm256_storeu_si256((__m256i *)(array + base), v);
+    }
+    merge_pass_ranks(&scalar_kernels, array, n, p, k, r, r1);
+}
+
+__attribute__((target("avx2")))
+static void sort_blocks_avx2(int *array, long n) {
+    __m256i partner[SIMD_MAX_STAGES];
+    __m256i take_max[SIMD_MAX_STAGES];
+    for (int s = 0; s < sort8_stages; s++) {
+        partner[s] = _mm256_loadu_si256((const __m256i *)sort8_tables[s].partner);
+        take_max[s] = _mm256_loadu_si256((const __m256i *)sort8_tables[s].take_max);
+    }
+    long i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(array + i));
+        for (int s = 0; s < sort8_stages; s++) {
+            __m256i w = _mm256_permutevar8x32_epi32(v, partner[s]);
+            v = _mm256_blendv_epi8(_mm256_min_epi32(v, w), _mm256_max_epi32(v, w), take_max[s]);
+        }
+        _mm256_storeu_si256((__m256i *)(array + i), v);
+    }
+    insertion_sort(array + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+static void compare_blocks_avx512(void *lo_ptr, void *hi_ptr, long len) {
+    int *lo = (int *)lo_ptr;
+    int *hi = (int *)hi_ptr;
+    long i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m512i a = _mm512_loadu_si512(lo + i);
+        __m512i b = _mm512_loadu_si512(hi + i);
+        _mm512_storeu_si512(lo + i, _mm512_min_epi32(a, b));
+        _mm512_storeu_si512(hi + i, _mm512_max_epi32(a, b));
+    }
+    compare_blocks_int32(lo + i, hi + i, len - i);
+}
+/* Проход с k < 16: вектор из 16 элементов с base = k + 2r */
+__attribute__((target("avx512f")))
+static void small_pass_avx512(int *array, long n, long p, long k, long r0, long r1) {
+    const lane_table_t *tables = shift16_tables[shift_table_index(k)];
+    __m512i partner[2];
+    __mmask16 max_mask[2];
+    for (int e = 0; e < 2; e++) {
+        partner[e] = _mm512_loadu_si512(tables[e].partner);
+        max_mask[e] = (__mmask16)tables[e].max_mask;
+    }
+    long r = r0;
+    for (; r + 8 <= r1; r += 8) {
+        long base = k + 2 * r;
+        if (base + 16 > n) break;
+        int e = (base + 16 - k) % (2 * p) == 0;
+        __m512i v = _mm512_loadu_si512(array + base);
+        __m512i w = _mm512_permutexvar_epi32(partner[e], v);
+        v = _mm512_mask_blend_epi32(max_mask[e], _mm512_min_epi32(v, w), _mm512_max_epi32(v, w));
+        _mm512_storeu_si512(array + base, v);
+    }
+    merge_pass_ranks(&scalar_kernels, array, n, p, k, r, r1);
+}
+
+__attribute__((target("avx512f")))
+static void sort_blocks_avx512(int *array, long n) {
+    __m512i partner[SIMD_MAX_STAGES];
+    __mmask16 max_mask[SIMD_MAX_STAGES];
+    for (int s = 0; s < sort16_stages; s++) {
+        partner[s] = _mm512_loadu_si512(sort16_tables[s].partner);
+        max_mask[s] = (__mmask16)sort16_tables[s].max_mask;
+    }
+    long i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i v = _mm512_loadu_si512(array + i);
+        for (int s = 0; s < sort16_stages; s++) {
+            __m512i w = _mm512_permutexvar_epi32(partner[s], v);
+            v = _mm512_mask_blend_epi32(max_mask[s], _mm512_min_epi32(v, w), _mm512_max_epi32(v, w));
+        }
+        _mm512_storeu_si512(array + i, v);
+    }
+    insertion_sort(array + i, n - i);
+}
+#endif
+
+/* Ядра поразрядной сортировки и поиска нарушения порядка для 32-битных ключей, общие для всех наборов int32 */
+#define RADIX_INT32 radix_count_int32, radix_scatter_int32, 32, first_descent_int32
+static const simd_kernels_t scalar_kernels = {
+    "scalar", sizeof(int32_t), 1, compare_blocks_int32, compare_blocks_int32, NULL, NULL, &pad_int32, RADIX_INT32
+};
+#if HAVE_X86_SIMD
+static const simd_kernels_t sse41_kernels = {
+    "sse4.1", sizeof(int32_t), 1, compare_blocks_sse41, compare_blocks_int32, NULL, NULL, &pad_int32, RADIX_INT32
+};
+static const simd_kernels_t avx2_kernels = {
+    "avx2", sizeof(int32_t), 8, compare_blocks_avx2, compare_blocks_int32, small_pass_avx2, sort_blocks_avx2,
+    &pad_int32, RADIX_INT32
+};
+static const simd_kernels_t avx512_kernels = {
+    "avx512", sizeof(int32_t), 16, compare_blocks_avx512, compare_blocks_int32, small_pass_avx512, sort_blocks_avx512,
+    &pad_int32, RADIX_INT32
+};
+#endif
+/* 64-битные ключи (int64, а после перекодирования также uint64 и double) и пары ключ-идентификатор */
+static const simd_kernels_t int64_kernels = {
+    "int64", sizeof(int64_t), 1, compare_blocks_int64, compare_blocks_int64, NULL, NULL, &pad_int64,
+    radix_count_int64, radix_scatter_int64, 64, first_descent_int64
+};
+static const simd_kernels_t pair_kernels = {
+    "key+id", sizeof(batcher_kv_t), 1, compare_blocks_pair, compare_blocks_pair, NULL, NULL, &pad_pair,
+    radix_count_pair, radix_scatter_pair, 64, first_descent_pair
+};
+/* Функция для получения наборов ядер для типа, поддерживаемых процессором, от простого к лучшему */
+static int supported_kernels(batcher_type_t type, const simd_kernels_t **list) {
+    if (type == BATCHER_INT64 || type == BATCHER_UINT64 || type == BATCHER_DOUBLE) {
+        list[0] = &int64_kernels;
+        return 1;
+    }
+    if (type == BATCHER_KV) {
+        list[0] = &pair_kernels;
+        return 1;
+    }
+    int count = 0;
+    list[count++] = &scalar_kernels;
+#if HAVE_X86_SIMD
+    __builtin_cpu_init();
+    lane_tables_init();
+    if (__builtin_cpu_supports("sse4.1")) list[count++] = &sse41_kernels;
+    if (__builtin_cpu_supports("avx2")) list[count++] = &avx2_kernels;
+    if (__builtin_cpu_supports("avx512f")) list[count++] = &avx512_kernels;
+#endif
+    return count;
+}
+/* Функция для выбора ядер по типу элементов и имени набора; без имени выбирается лучший набор,
+   скалярная версия остается запасной */
+static const simd_kernels_t *select_kernels(batcher_type_t type, const char *name) {
+    const simd_kernels_t *list[4];
+    int count = supported_kernels(type, list);
+    if (!name) return list[count - 1];
+    for (int i = 0; i < count; i++) {
+        if (strcmp(list[i]->name, name) == 0) return list[i];
+    }
+    return NULL;
+}
+/* Функция для получения времени по монотонным часам в секундах */
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+/* Функция для сохранения времени прохода (p, k) */
+static void stats_add_pass(batcher_stats_t *stats, long p, long k, double seconds) {
+    if (!stats) return;
+    if (stats->pass_count == stats->pass_capacity) {
+        long capacity = stats->pass_capacity ? stats->pass_capacity * 2 : 64;
+        batcher_pass_time_t *passes = realloc(stats->passes, (size_t)capacity * sizeof(batcher_pass_time_t));
+        if (!passes) return;
+        stats->passes = passes;
+        stats->pass_capacity = capacity;
+    }
+    stats->passes[stats->pass_count++] = (batcher_pass_time_t){ p, k, seconds };
+}
+/* Функция для выполнения рангов [r0, r1) прохода (p, k) векторным или блочным ядром */
+static void run_pass_ranks(const sort_data_t *data, long p, long k, long r0, long r1) {
+    if (k < data->kernels->lanes) {
+        data->kernels->small_pass(data->array, data->n, p, k, r0, r1);
+    } else {
+        merge_pass_ranks(data->kernels, data->array, data->n, p, k, r0, r1);
+    }
+}
+/* Функция для проверки перед стадией p, что блок 2p с началом first уже упорядочен: его половины
+   отсортированы предыдущими стадиями, поэтому достаточно пары на их границе. Все сравнения сети
+   направлены от меньшего индекса к большему, и в таком блоке ни одно из них не меняет элементы */
+static bool stage_block_ordered(const sort_data_t *data, long p, long first) {
+    long mid = first + p;
+    return mid >= data->n || data->kernels->first_descent(data->array, mid, mid + 1) > mid;
+}
+/* Функция для выполнения единиц работы [r0, r1) текущего прохода потоком с номером index */
+static void thread_pool_run_range(thread_pool_t *pool, int index, long r0, long r1) {
+    sort_data_t *data = pool->data;
+    const pass_desc_t *pass = &pool->pass;
+    long skipped = 0;
+    if (r0 >= r1) return;
+    if (pass->kind == PASS_CHECK) {
+        /* Доля проверяется вместе с парой на ее нижней границе */
+        long first = r0 > 0 ? r0 : 1;
+        if (first < r1 && data->kernels->first_descent(data->array, first, r1) < r1) {
+            atomic_store_explicit(&data->unsorted, true, memory_order_relaxed);
+        }
+    } else if (pass->kind == PASS_TOUCH) {
+        size_t elem_size = data->kernels->elem_size;
+        memset((char *)pass->dst + (size_t)r0 * elem_size, 0, (size_t)(r1 - r0) * elem_size);
+    } else if (pass->kind == PASS_RADIX_COUNT) {
+        data->kernels->radix_count(pass->src, r0, r1, pass->shift, data->radix_counts[index]);
+    } else if (pass->kind == PASS_RADIX_SCATTER) {
+        data->kernels->radix_scatter(pass->src, pass->dst, r0, r1, pass->shift, data->radix_counts[index]);
+    } else if (pass->kind == PASS_STAGE) {
+        /* Блок b стадии p - ранги [b * p, (b + 1) * p) каждого ее прохода, и проходы блока
+           зависят только друг от друга, поэтому выполняются подряд без барьеров */
+        for (long block = r0; block < r1; block++) {
+            if (data->adaptive && stage_block_ordered(data, pass->p, block * 2 * pass->p)) {
+                skipped++;
+                continue;
+            }
+            for (long k = pass->p; k >= 1; k /= 2) {
+                long first = block * pass->p;
+                long last = merge_pass_total(data->n, pass->p, k);
+                if (last > first + pass->p) last = first + pass->p;
+                if (first >= last) continue;
+                run_pass_ranks(data, pass->p, k, first, last);
+            }
+        }
+    } else if (pass->local > 0) {
+        /* Блок сортируется всеми стадиями, пока находится в кэше */
+        for (long block = r0; block < r1; block++) {
+            long start = block * pass->local;
+            long len = data->n - start < pass->local ? data->n - start : pass->local;
+            char *tile = (char *)data->array + start * data->kernels->elem_size;
+            if (data->adaptive && data->kernels->first_descent(tile, 1, len) == len) {
+                skipped++;
+                continue;
+            }
+            local_sort(data->kernels, tile, len);
+        }
+    } else if (data->ordered) {
+        /* Ранги блока b стадии - [b * p, (b + 1) * p) каждого ее прохода; упорядоченные блоки пропускаются */
+        while (r0 < r1) {
+            long block = r0 / pass->p;
+            long end = (block + 1) * pass->p < r1 ? (block + 1) * pass->p : r1;
+            if (!data->ordered[block]) run_pass_ranks(data, pass->p, pass->k, r0, end);
+            r0 = end;
+        }
+    } else {
+        run_pass_ranks(data, pass->p, pass->k, r0, r1);
+    }
+    if (data->stats && skipped > 0) __atomic_fetch_add(&data->stats->skipped, skipped, __ATOMIC_RELAXED);
+}
+
+#define DEQUE_PACK(head, tail) (((uint64_t)(head) << 32) | (uint64_t)(tail))
+#define DEQUE_HEAD(range) ((long)((range) >> 32))
+#define DEQUE_TAIL(range) ((long)((range) & UINT32_MAX))
+/* Функция для взятия порции из начала своей очереди */
+static bool deque_pop(steal_deque_t *deque, long *chunk) {
+    uint64_t range = atomic_load(&deque->range);
+    while (DEQUE_HEAD(range) < DEQUE_TAIL(range)) {
+        if (atomic_compare_exchange_weak(&deque->range, &range, range + ((uint64_t)1 << 32))) {
+            *chunk = DEQUE_HEAD(range);
+            return true;
+        }
+    }
+    return false;
+}
+/* Функция для захвата половины порций (не меньше одной) с конца чужой очереди в свою пустую очередь */
+static bool deque_steal(steal_deque_t *victim, steal_deque_t *own) {
+    uint64_t range = atomic_load(&victim->range);
+    while (DEQUE_HEAD(range) < DEQUE_TAIL(range)) {
+        long head = DEQUE_HEAD(range);
+        long tail = DEQUE_TAIL(range);
+        long split = tail - (tail - head + 1) / 2;
+        if (atomic_compare_exchange_weak(&victim->range, &range, DEQUE_PACK(head, split))) {
+            atomic_store(&own->range, DEQUE_PACK(split, tail));
+            return true;
+        }
+    }
+    return false;
+}
+/* Функция для выполнения доли текущего прохода потоком с номером index. Без захвата работы
+   поток выполняет chunk единиц со своим номером. С захватом он выполняет порции своей очереди,
+   а когда она пуста, забирает порции у следующих по кругу потоков; проход для потока закончен,
+   когда пусты все очереди. Порции не порождают новых, поэтому работа, забранная другим потоком,
+   но еще не положенная в его очередь, будет выполнена им самим */
+static void thread_pool_run_share(thread_pool_t *pool, int index) {
+    sort_data_t *data = pool->data;
+    const pass_desc_t *pass = &pool->pass;
+    double started = data->stats ? now_seconds() : 0.0;
+    if (!pass->steal) {
+        long r0 = (long)index * pass->chunk;
+        long r1 = r0 + pass->chunk;
+        if (r1 > pass->total) r1 = pass->total;
+        thread_pool_run_range(pool, index, r0, r1);
+    } else if (index < pass->workers) {
+        long steals = 0;
+        long chunk;
+        while (true) {
+            if (deque_pop(&pool->deques[index], &chunk)) {
+                long r0 = chunk * pass->chunk;
+                long r1 = r0 + pass->chunk < pass->total ? r0 + pass->chunk : pass->total;
+                thread_pool_run_range(pool, index, r0, r1);
+                continue;
+            }
+            bool stolen = false;
+            for (int v = 1; v < pass->workers && !stolen; v++) {
+                stolen = deque_steal(&pool->deques[(index + v) % pass->workers], &pool->deques[index]);
+            }
+            if (!stolen) break;
+            steals++;
+        }
+        if (data->stats && steals > 0) __atomic_fetch_add(&data->stats->steals, steals, __ATOMIC_RELAXED);
+    }
+    /* Каждый поток пишет только в свою ячейку; читаются ячейки после завершения пула */
+    if (data->stats) data->stats->busy[index] += now_seconds() - started;
+}
+/* Функция для закрепления текущего потока на процессоре потока пула с номером index */
+static void thread_pool_pin(const thread_pool_t *pool, int index) {
+    if (pool->cpu_count == 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(pool->cpus[index % pool->cpu_count], &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        print_stderr("Warning: Failed to set thread affinity\n");
+    }
+}
+/* Функция рабочего потока пула: ожидание прохода, выполнение своей доли, ожидание остальных */
+static void *thread_pool_worker(void *arg) {
+    thread_data_t *tdata = (thread_data_t *)arg;
+    thread_pool_t *pool = tdata->pool;
+    thread_pool_pin(pool, tdata->index);
+    /* Ожидание, пока пул не будет полностью создан */
+    pthread_mutex_lock(&pool->start_mutex);
+    while (!pool->started) {
+        pthread_cond_wait(&pool->start_cond, &pool->start_mutex);
+    }
+    pthread_mutex_unlock(&pool->start_mutex);
+    if (pool->failed) return NULL;
+    while (true) {
+        pthread_barrier_wait(&pool->start_barrier);
+        if (pool->shutdown) break;
+        thread_pool_run_share(pool, tdata->index);
+        pthread_barrier_wait(&pool->done_barrier);
+    }
+    return NULL;
+}
+/* Функция, которой внешний исполнитель выполняет долю прохода с номером index */
+static void thread_pool_task(void *arg, int index) {
+    thread_pool_run_share((thread_pool_t *)arg, index);
+}
+/* Функция для создания пула: вызывающий поток считается потоком с номером 0.
+   С внешним исполнителем потоки не создаются и не закрепляются, а размер пула равен числу его потоков */
+static bool thread_pool_init(thread_pool_t *pool, sort_data_t *data, int size, const batcher_executor_t *executor,
+                             const int *cpus, int cpu_count) {
+    pool->data = data;
+    pool->size = size;
+    pool->executor = executor;
+    pool->cpus = cpus;
+    pool->cpu_count = executor ? 0 : cpu_count;
+    pool->shutdown = false;
+    pool->started = false;
+    pool->failed = false;
+    pool->threads = NULL;
+    pool->tdata = NULL;
+    pool->caller_pinned = false;
+    pool->steal = false;
+    if (executor) size = executor->threads > 1 ? executor->threads : 1;
+    pool->deques = (steal_deque_t *)aligned_alloc(_Alignof(steal_deque_t), (size_t)size * sizeof(steal_deque_t));
+    if (!pool->deques) {
+        print_stderr("Error: Memory allocation failed\n");
+        return false;
+    }
+    if (executor) {
+        pool->size = size;
+        return true;
+    }
+    pool->caller_pinned = pool->cpu_count > 0 &&
+                          pthread_getaffinity_np(pthread_self(), sizeof(pool->caller_cpus), &pool->caller_cpus) == 0;
+    if (pool->caller_pinned) thread_pool_pin(pool, 0);
+    if (size <= 1) return true;
+
+    pool->threads = (pthread_t *)malloc((size_t)size * sizeof(pthread_t));
+    pool->tdata = (thread_data_t *)malloc((size_t)size * sizeof(thread_data_t));
+    if (!pool->threads || !pool->tdata) {
+        print_stderr("Error: Memory allocation failed\n");
+        free(pool->threads);
+        free(pool->tdata);
+        pool->threads = NULL;
+        pool->tdata = NULL;
+        pool->size = 1;
+        return true;
+    }
+    pthread_mutex_init(&pool->start_mutex, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    /* Если поток не удалось создать, пул сжимается до уже созданных потоков */
+    int created = 1;
+    for (int t = 1; t < size; t++) {
+        pool->tdata[t].pool = pool;
+        pool->tdata[t].index = t;
+        if (pthread_create(&pool->threads[t], NULL, thread_pool_worker, &pool->tdata[t]) != 0) {
+            print_stderr("Error: Failed to create thread\n");
+            break;
+        }
+        created++;
+    }
+    pool->size = created;
+    /* Если не создан ни один поток, пул однопоточный и ресурсы для потоков освобождаются сразу:
+       thread_pool_destroy при размере 1 их не трогает */
+    if (created == 1) {
+        pthread_mutex_destroy(&pool->start_mutex);
+        pthread_cond_destroy(&pool->start_cond);
+        free(pool->threads);
+        free(pool->tdata);
+        pool->threads = NULL;
+        pool->tdata = NULL;
+        return true;
+    }
+    /* Барьеры создаются после потоков, когда известно их точное количество */
+    bool ok = pthread_barrier_init(&pool->start_barrier, NULL, (unsigned)created) == 0;
+    if (ok && pthread_barrier_init(&pool->done_barrier, NULL, (unsigned)created) != 0) {
+        pthread_barrier_destroy(&pool->start_barrier);
+        ok = false;
+    }
+    if (!ok) {
+        print_stderr("Error: Failed to initialize barrier\n");
+        pool->failed = true;
+    }
+    pthread_mutex_lock(&pool->start_mutex);
+    pool->started = true;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->start_mutex);
+    if (!ok) {
+        for (int t = 1; t < created; t++) {
+            pthread_join(pool->threads[t], NULL);
+        }
+        pthread_mutex_destroy(&pool->start_mutex);
+        pthread_cond_destroy(&pool->start_cond);
+        free(pool->threads);
+        free(pool->tdata);
+        free(pool->deques);
+        if (pool->caller_pinned) pthread_setaffinity_np(pthread_self(), sizeof(pool->caller_cpus), &pool->caller_cpus);
+        return false;
+    }
+    return true;
+}
+/* Функция для завершения работы пула */
+static void thread_pool_destroy(thread_pool_t *pool) {
+    if (pool->caller_pinned) pthread_setaffinity_np(pthread_self(), sizeof(pool->caller_cpus), &pool->caller_cpus);
+    free(pool->deques);
+    if (pool->executor || pool->size <= 1) return;
+    pool->shutdown = true;
+    pthread_barrier_wait(&pool->start_barrier);
+    for (int t = 1; t < pool->size; t++) {
+        pthread_join(pool->threads[t], NULL);
+    }
+    pthread_barrier_destroy(&pool->start_barrier);
+    pthread_barrier_destroy(&pool->done_barrier);
+    pthread_mutex_destroy(&pool->start_mutex);
+    pthread_cond_destroy(&pool->start_cond);
+    free(pool->threads);
+    free(pool->tdata);
+}
+/* Функция для запуска прохода в пуле: total единиц работы делятся между потоками порциями, кратными unit.
+   С захватом работы порции мельче доли потока, и очередь каждого потока изначально содержит
+   подряд идущие порции его доли */
+static void thread_pool_run_pass(thread_pool_t *pool, long total, long unit, bool steal) {
+    if (total <= 0) return;
+    long units = (total + unit - 1) / unit;
+    /* Определение количества потоков для использования */
+    int threads_to_use = pool->size;
+    if (threads_to_use > units) {
+        threads_to_use = (int)units;
+    }
+    pool->pass.total = total;
+    pool->pass.steal = false;
+    /* Если количество потоков равно 1, то проход выполняется без использования потоков */
+    if (threads_to_use <= 1) {
+        pool->pass.chunk = total;
+        thread_pool_run_share(pool, 0);
+        return;
+    }
+    /* Определение доли одного потока и запуск прохода в пуле */
+    pool->pass.chunk = (units + threads_to_use - 1) / threads_to_use * unit;
+    long per_chunk = (units + (long)threads_to_use * STEAL_CHUNKS_PER_THREAD - 1) /
+                     ((long)threads_to_use * STEAL_CHUNKS_PER_THREAD);
+    long chunks = (units + per_chunk - 1) / per_chunk;
+    if (steal && chunks <= UINT32_MAX) {
+        pool->pass.steal = true;
+        pool->pass.chunk = per_chunk * unit;
+        pool->pass.chunks = chunks;
+        pool->pass.workers = threads_to_use;
+        for (int t = 0; t < threads_to_use; t++) {
+            atomic_store(&pool->deques[t].range, DEQUE_PACK(chunks * t / threads_to_use, chunks * (t + 1) / threads_to_use));
+        }
+    }
+    if (pool->executor) {
+        pool->executor->run(pool->executor->user, threads_to_use, thread_pool_task, pool);
+        return;
+    }
+    /* Потоки пула с номерами от threads_to_use получают пустые доли */
+    pthread_barrier_wait(&pool->start_barrier);
+    thread_pool_run_share(pool, 0);
+    pthread_barrier_wait(&pool->done_barrier);
+}
+/* Функция для выполнения прохода (p, k) сети слияния: доли потоков кратны ширине вектора */
+static void batcher_merge(long n, long p, long k, thread_pool_t *pool) {
+    pool->pass.kind = PASS_NETWORK;
+    pool->pass.p = p;
+    pool->pass.k = k;
+    pool->pass.local = 0;
+    double started = now_seconds();
+    thread_pool_run_pass(pool, merge_pass_total(n, p, k), pool->data->kernels->lanes, pool->steal);
+    stats_add_pass(pool->data->stats, p, k, now_seconds() - started);
+}
+/* Функция для сортировки выровненных блоков по local элементов: все сравнения стадий
+   с 2p <= local не выходят за границы блока, поэтому блоки независимы и целиком принадлежат потокам */
+static void batcher_local_sort(long n, long local, thread_pool_t *pool) {
+    pool->pass.kind = PASS_NETWORK;
+    pool->pass.local = local;
+    double started = now_seconds();
+    thread_pool_run_pass(pool, (n + local - 1) / local, 1, pool->steal);
+    stats_add_pass(pool->data->stats, local, 0, now_seconds() - started);
+}
+/* Функция для выполнения всей стадии p блоками по 2p элементов: сравнения стадии не выходят
+   за границы блока, поэтому поток, закончивший проход (p, k) в своем блоке, сразу переходит
+   к (p, k / 2) в нем же, не дожидаясь остальных потоков на барьере */
+static void batcher_stage(long n, long p, thread_pool_t *pool) {
+    pool->pass.kind = PASS_STAGE;
+    pool->pass.p = p;
+    pool->pass.local = 0;
+    double started = now_seconds();
+    thread_pool_run_pass(pool, (n + 2 * p - 1) / (2 * p), 1, pool->steal);
+    stats_add_pass(pool->data->stats, p, -1, now_seconds() - started);
+}
+/* Функция для получения буфера дополнения не меньше size байт */
+static bool pad_pool_reserve(pad_pool_t *pad_pool, size_t size) {
+    if (pad_pool->capacity >= size) return true;
+    void *data = realloc(pad_pool->data, size);
+    if (!data) return false;
+    pad_pool->data = data;
+    pad_pool->capacity = size;
+    return true;
+}
+
+static void pad_pool_free(pad_pool_t *pad_pool) {
+    free(pad_pool->data);
+    pad_pool->data = NULL;
+    pad_pool->capacity = 0;
+}
+/* Функция для четно-нечетной сортировки Бетчера слиянием для произвольного n
+   с виртуальным дополнением до степени двойки в пуле контекста */
+static void batcher_sort_network(batcher_context_t *ctx, void *array, long n) {
+    const sort_config_t *config = &ctx->config;
+    const simd_kernels_t *kernels = config->kernels;
+    thread_pool_t *pool = &ctx->pool;
+    ctx->data.array = array;
+    ctx->data.n = n;
+    double compute_started = now_seconds();
+    /* Начальные стадии выполняются поблочно: блок размером с плитку (но не меньше вектора)
+       сортируется целиком, пока находится в кэше. Блоков должно хватать на все потоки */
+    long local = config->tile > kernels->lanes ? config->tile : kernels->lanes;
+    while (local > kernels->lanes && (n + local - 1) / local < pool->size) {
+        local /= 2;
+    }
+    long first = 1;
+    if (local > 1) {
+        batcher_local_sort(n, local, pool);
+        first = local;
+    }
+    /* Цикл по стадиям: на стадии p сливаются отсортированные блоки по p элементов */
+    for (long p = first; p < n; p *= 2) {
+        long blocks = (n + 2 * p - 1) / (2 * p);
+        /* Пока блоков стадии хватает на все потоки, стадия выполняется без барьеров между проходами.
+           Ранги блока кратны p, а векторные проходы требуют рангов, кратных ширине вектора */
+        if (pool->steal && p >= kernels->lanes && blocks >= (long)pool->size * STAGE_BLOCKS_PER_THREAD) {
+            batcher_stage(n, p, pool);
+            continue;
+        }
+        /* В адаптивном режиме упорядоченные блоки отмечаются до первого прохода стадии, пока
+           проходы не переставили их элементы; стадия без неупорядоченных блоков пропускается */
+        ctx->data.ordered = NULL;
+        if (ctx->data.adaptive && pad_pool_reserve(&ctx->ordered_pool, (size_t)blocks)) {
+            uint8_t *ordered = (uint8_t *)ctx->ordered_pool.data;
+            long count = 0;
+            for (long b = 0; b < blocks; b++) {
+                ordered[b] = stage_block_ordered(&ctx->data, p, b * 2 * p);
+                count += ordered[b];
+            }
+            if (config->stats) config->stats->skipped += count;
+            if (count == blocks) continue;
+            if (count > 0) ctx->data.ordered = ordered;
+        }
+        /* Цикл по проходам стадии с расстоянием сравнения k */
+        for (long k = p; k >= 1; k /= 2) {
+            batcher_merge(n, p, k, pool);
+        }
+    }
+    ctx->data.ordered = NULL;
+    if (config->stats) config->stats->compute += now_seconds() - compute_started;
+}
+/* Функция для четно-нечетной сортировки Бетчера */
+static void batcher_odd_even_sort(batcher_context_t *ctx, void *array, long n) {
+    const sort_config_t *config = &ctx->config;
+    pad_pool_t *pad_pool = &ctx->pad_pool;
+    if (n <= 1) return;
+    long padded = 1;
+    while (padded < n) padded *= 2;
+    /* Для степени двойки дополнение не нужно, сеть выполняется прямо на массиве */
+    if (padded == n || config->pad == BATCHER_PAD_VIRTUAL) {
+        batcher_sort_network(ctx, array, n);
+        return;
+    }
+    size_t elem_size = config->kernels->elem_size;
+    if (!pad_pool_reserve(pad_pool, (size_t)padded * elem_size)) {
+        print_stderr("Error: Memory allocation failed, using virtual padding\n");
+        batcher_sort_network(ctx, array, n);
+        return;
+    }
+    double started = now_seconds();
+    char *padded_array = (char *)pad_pool->data;
+    memcpy(padded_array, array, (size_t)n * elem_size);
+    for (long i = n; i < padded; i++) {
+        memcpy(padded_array + i * elem_size, config->kernels->pad_value, elem_size);
+    }
+    double copied = now_seconds();
+    batcher_sort_network(ctx, padded_array, padded);
+    double sorted = now_seconds();
+    memcpy(array, padded_array, (size_t)n * elem_size);
+    if (config->stats) config->stats->padding += (copied - started) + (now_seconds() - sorted);
+}
+
+/* Функция для сортировки сетью в вызывающем потоке без пула. Массив не длиннее вектора
+   дополняется до его ширины максимальным ключом и сортируется целиком в регистре */
+static void register_sort(batcher_context_t *ctx, void *array, long n) {
+    const simd_kernels_t *kernels = ctx->config.kernels;
+    if (n <= 1) return;
+    if (kernels->lanes > 1 && n <= kernels->lanes) {
+        int32_t block[SIMD_MAX_LANES];
+        memcpy(block, array, (size_t)n * sizeof(int32_t));
+        for (long i = n; i < kernels->lanes; i++) {
+            block[i] = INT32_MAX;
+        }
+        kernels->sort_blocks(block, kernels->lanes);
+        memcpy(array, block, (size_t)n * sizeof(int32_t));
+        return;
+    }
+    local_sort(kernels, array, n);
+}
+/* Функция для поразрядной сортировки перекодированных ключей в пуле. Каждый байт ключа -
+   два прохода пула с одинаковым разбиением src на доли потоков: подсчет корзин в своей доле,
+   затем раскладка своей доли. Между ними вызывающий поток превращает счетчики в начальные
+   позиции: корзина b потока t пишется после всех меньших корзин и после корзины b потоков
+   с меньшими номерами, поэтому сортировка устойчива. Буферы меняются ролями после каждого байта */
+static void radix_sort(batcher_context_t *ctx, void *array, long n) {
+    const simd_kernels_t *kernels = ctx->config.kernels;
+    thread_pool_t *pool = &ctx->pool;
+    long (*counts)[RADIX_BUCKETS] = ctx->data.radix_counts;
+    size_t elem_size = kernels->elem_size;
+    if (n <= 1) return;
+    if (!pad_pool_reserve(&ctx->radix_pool, (size_t)n * elem_size)) {
+        print_stderr("Error: Memory allocation failed, using the sorting network\n");
+        batcher_odd_even_sort(ctx, array, n);
+        return;
+    }
+    ctx->data.array = array;
+    ctx->data.n = n;
+    void *src = array;
+    void *dst = ctx->radix_pool.data;
+    for (unsigned shift = 0; shift < kernels->key_bits; shift += RADIX_BITS) {
+        memset(counts, 0, (size_t)pool->size * sizeof(*counts));
+        pool->pass.kind = PASS_RADIX_COUNT;
+        pool->pass.local = 0;
+        pool->pass.shift = shift;
+        pool->pass.src = src;
+        pool->pass.dst = dst;
+        thread_pool_run_pass(pool, n, 1, false);
+        long offset = 0;
+        bool single_bucket = false;
+        for (int b = 0; b < RADIX_BUCKETS; b++) {
+            long bucket = 0;
+            for (int t = 0; t < pool->size; t++) {
+                long count = counts[t][b];
+                counts[t][b] = offset + bucket;
+                bucket += count;
+            }
+            /* Все ключи в одной корзине: байт не меняет порядок, проход пропускается */
+            if (bucket == n) single_bucket = true;
+            offset += bucket;
+        }
+        if (single_bucket) continue;
+        pool->pass.kind = PASS_RADIX_SCATTER;
+        thread_pool_run_pass(pool, n, 1, false);
+        void *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != array) memcpy(array, src, (size_t)n * elem_size);
+}
+/* Функция для выбора алгоритма: до register_max элементов запуск прохода в пуле дороже самих
+   сравнений, а начиная с radix_min линейная поразрядная сортировка обгоняет n log^2 n сравнений сети */
+static batcher_engine_t select_engine(const batcher_context_t *ctx, long n) {
+    if (ctx->engine != BATCHER_ENGINE_AUTO) return ctx->engine;
+    if (n <= ctx->register_max) return BATCHER_ENGINE_REGISTER;
+    if (ctx->radix_min > 0 && n >= ctx->radix_min) return BATCHER_ENGINE_RADIX;
+    return BATCHER_ENGINE_NETWORK;
+}
+/* Функция для сортировки перекодированных ключей выбранным алгоритмом */
+static void sort_with_engine(batcher_context_t *ctx, batcher_engine_t engine, void *array, long n) {
+    if (engine == BATCHER_ENGINE_NETWORK) {
+        batcher_odd_even_sort(ctx, array, n);
+        return;
+    }
+    double started = now_seconds();
+    if (engine == BATCHER_ENGINE_RADIX) {
+        radix_sort(ctx, array, n);
+    } else {
+        register_sort(ctx, array, n);
+    }
+    if (ctx->config.stats) ctx->config.stats->compute += now_seconds() - started;
+}
+/* Функция для замера алгоритма: лучшее время из reps сортировок копии input */
+static double time_engine(batcher_context_t *ctx, batcher_engine_t engine, const void *input, void *work,
+                          long n, int reps) {
+    size_t bytes = (size_t)n * ctx->config.kernels->elem_size;
+    double best = 0.0;
+    for (int r = 0; r < reps; r++) {
+        memcpy(work, input, bytes);
+        double started = now_seconds();
+        sort_with_engine(ctx, engine, work, n);
+        double elapsed = now_seconds() - started;
+        if (r == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+/* Функция для калибровки порогов на случайных ключах размеров 16, 32, ..., CALIBRATION_MAX_N.
+   register_max - наибольший размер, до которого сеть в одном потоке быстрее остальных алгоритмов;
+   radix_min - наименьший размер, начиная с которого поразрядная сортировка быстрее на всех больших размерах */
+static void calibrate(batcher_context_t *ctx) {
+    size_t bytes = (size_t)CALIBRATION_MAX_N * ctx->config.kernels->elem_size;
+    char *input = (char *)malloc(bytes);
+    char *work = (char *)malloc(bytes);
+    if (!input || !work) {
+        print_stderr("Error: Memory allocation failed, using default thresholds\n");
+        free(input);
+        free(work);
+        return;
+    }
+    uint64_t state = UINT64_C(0x9E3779B97F4A7C15);
+    for (size_t i = 0; i + sizeof(state) <= bytes; i += sizeof(state)) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        memcpy(input + i, &state, sizeof(state));
+    }
+    long register_max = 0;
+    long radix_min = 0;
+    bool register_wins = true;
+    for (long n = 16; n <= CALIBRATION_MAX_N; n *= 2) {
+        int reps = n < 16384 ? 64 : 3;
+        double network = time_engine(ctx, BATCHER_ENGINE_NETWORK, input, work, n, reps);
+        double radix = time_engine(ctx, BATCHER_ENGINE_RADIX, input, work, n, reps);
+        double best = network;
+        /* Сеть в одном потоке замеряется, пока она выигрывает: дальше ее время растет быстрее остальных */
+        if (register_wins) {
+            double single = time_engine(ctx, BATCHER_ENGINE_REGISTER, input, work, n, reps);
+            register_wins = single <= network && single <= radix;
+            if (register_wins) register_max = n;
+            if (single < best) best = single;
+        }
+        if (radix < best) {
+            if (radix_min == 0) radix_min = n;
+        } else {
+            radix_min = 0;
+        }
+    }
+    free(input);
+    free(work);
+    ctx->register_max = register_max;
+    ctx->radix_min = radix_min;
+}
+/* Функция для чтения порогов из файла калибровки. Строка файла:
+   "<набор ядер> <размер элемента> <число потоков> <register_max> <radix_min>"; строки с # пропускаются */
+static bool calibration_load(batcher_context_t *ctx, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) return false;
+    char line[BUF_SIZE];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), file)) {
+        char kernels[32];
+        size_t elem_size;
+        int threads;
+        long register_max, radix_min;
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%31s %zu %d %ld %ld", kernels, &elem_size, &threads, &register_max, &radix_min) != 5) continue;
+        if (strcmp(kernels, ctx->config.kernels->name) != 0 || elem_size != ctx->config.kernels->elem_size ||
+            threads != ctx->pool.size) {
+            continue;
+        }
+        ctx->register_max = register_max;
+        ctx->radix_min = radix_min;
+        found = true;
+    }
+    fclose(file);
+    return found;
+}
+/* Функция для дописывания порогов контекста в файл калибровки */
+static void calibration_save(const batcher_context_t *ctx, const char *path) {
+    FILE *file = fopen(path, "a");
+    if (!file) {
+        print_stderr("Error: cannot write the calibration file\n");
+        return;
+    }
+    if (ftell(file) == 0) {
+        fprintf(file, "# kernels elem_size threads register_max radix_min\n");
+    }
+    fprintf(file, "%s %zu %d %ld %ld\n", ctx->config.kernels->name, ctx->config.kernels->elem_size,
+            ctx->pool.size, ctx->register_max, ctx->radix_min);
+    fclose(file);
+}
+
+/* Функция для перекодирования ключей в знаковые целые того же размера с тем же порядком.
+   Для float и double получается полный порядок IEEE 754:
+   -NaN < -inf < ... < -0 < +0 < ... < +inf < +NaN; для uint64 инвертируется старший бит */
+static void encode_keys(batcher_type_t type, void *array, long n) {
+    for (long i = 0; i < n; i++) {
+        if (type == BATCHER_FLOAT) {
+            float value = ((float *)array)[i];
+            int32_t key;
+            memcpy(&key, &value, sizeof(key));
+            ((int32_t *)array)[i] = key < 0 ? key ^ INT32_MAX : key;
+        } else if (type == BATCHER_DOUBLE) {
+            double value = ((double *)array)[i];
+            int64_t key;
+            memcpy(&key, &value, sizeof(key));
+            ((int64_t *)array)[i] = key < 0 ? key ^ INT64_MAX : key;
+        } else if (type == BATCHER_UINT64) {
+            uint64_t value = ((uint64_t *)array)[i] ^ (UINT64_C(1) << 63);
+            ((int64_t *)array)[i] = (int64_t)value;
+        }
+    }
+}
+/* Функция для обратного перекодирования ключей после сортировки */
+static void decode_keys(batcher_type_t type, void *array, long n) {
+    for (long i = 0; i < n; i++) {
+        if (type == BATCHER_FLOAT) {
+            int32_t key = ((int32_t *)array)[i];
+            key = key < 0 ? key ^ INT32_MAX : key;
+            float value;
+            memcpy(&value, &key, sizeof(value));
+            ((float *)array)[i] = value;
+        } else if (type == BATCHER_DOUBLE) {
+            int64_t key = ((int64_t *)array)[i];
+            key = key < 0 ? key ^ INT64_MAX : key;
+            double value;
+            memcpy(&value, &key, sizeof(value));
+            ((double *)array)[i] = value;
+        } else if (type == BATCHER_UINT64) {
+            uint64_t value = (uint64_t)((int64_t *)array)[i];
+            ((uint64_t *)array)[i] = value ^ (UINT64_C(1) << 63);
+        }
+    }
+}
+
+
+/* Функция для получения ключа i-го элемента, порядок которого совпадает с полным порядком типа */
+static int64_t total_order_key(batcher_type_t type, const void *array, long i) {
+    switch (type) {
+        case BATCHER_INT32: return ((const int32_t *)array)[i];
+        case BATCHER_FLOAT: {
+            int32_t key;
+            memcpy(&key, (const float *)array + i, sizeof(key));
+            return key < 0 ? key ^ INT32_MAX : key;
+        }
+        case BATCHER_DOUBLE: {
+            int64_t key;
+            memcpy(&key, (const double *)array + i, sizeof(key));
+            return key < 0 ? key ^ INT64_MAX : key;
+        }
+        case BATCHER_UINT64: return (int64_t)(((const uint64_t *)array)[i] ^ (UINT64_C(1) << 63));
+        default: return ((const int64_t *)array)[i];
+    }
+}
+
+/* Функция для добавления процессоров из списка вида "0-3,8-11", разрешенных процессу и еще
+   не добавленных, в cpus; возвращает новое число процессоров */
+static int cpu_list_parse(const char *text, const cpu_set_t *allowed, cpu_set_t *seen, int *cpus, int count) {
+    while (*text) {
+        char *end;
+        long first = strtol(text, &end, 10);
+        if (end == text) break;
+        long last = first;
+        if (*end == '-') last = strtol(end + 1, &end, 10);
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            if (cpu < 0 || !CPU_ISSET(cpu, allowed) || CPU_ISSET(cpu, seen)) continue;
+            CPU_SET(cpu, seen);
+            cpus[count++] = (int)cpu;
+        }
+        if (*end != ',') break;
+        text = end + 1;
+    }
+    return count;
+}
+/* Функция для порядка закрепления потоков пула: compact заполняет узлы NUMA по очереди,
+   scatter берет по процессору из каждого узла. Узлы читаются из sysfs; без них все
+   разрешенные процессу процессоры считаются одним узлом. Возвращает число процессоров */
+static int cpu_order(batcher_affinity_t affinity, int *cpus) {
+    cpu_set_t allowed, seen;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return 0;
+    CPU_ZERO(&seen);
+    int *by_node = (int *)malloc(CPU_SETSIZE * sizeof(int));
+    if (!by_node) return 0;
+    int node_start[MAX_NUMA_NODES + 1];
+    int nodes = 0;
+    int count = 0;
+    char path[BUF_SIZE];
+    char line[BUF_SIZE * 4];
+    for (int node = 0; node < MAX_NUMA_NODES; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *file = fopen(path, "r");
+        if (!file) continue;
+        if (fgets(line, sizeof(line), file)) {
+            int added = cpu_list_parse(line, &allowed, &seen, by_node, count);
+            if (added > count) {
+                node_start[nodes++] = count;
+                count = added;
+            }
+        }
+        fclose(file);
+    }
+    /* Процессоры, не найденные в узлах, образуют последний узел */
+    int rest = count;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && !CPU_ISSET(cpu, &seen)) by_node[count++] = cpu;
+    }
+    if (count > rest) node_start[nodes++] = rest;
+    node_start[nodes] = count;
+    if (affinity == BATCHER_AFFINITY_COMPACT) {
+        memcpy(cpus, by_node, (size_t)count * sizeof(int));
+    } else {
+        int placed = 0;
+        for (int j = 0; placed < count; j++) {
+            for (int node = 0; node < nodes; node++) {
+                if (node_start[node] + j < node_start[node + 1]) cpus[placed++] = by_node[node_start[node] + j];
+            }
+        }
+    }
+    free(by_node);
+    return count;
+}
+
+static int tile_size_from(int requested) {
+    if (requested < 2) return 0;
+    int tile = 2;
+    while (tile <= requested / 2) tile *= 2;
+    return tile;
+}
+
+void batcher_options_init(batcher_options_t *options) {
+    options->type = BATCHER_INT32;
+    options->max_threads = 1;
+    options->tile = BATCHER_DEFAULT_TILE;
+    options->pad = BATCHER_PAD_VIRTUAL;
+    options->kernels = NULL;
+    options->stats = NULL;
+    options->executor = NULL;
+    options->engine = BATCHER_ENGINE_AUTO;
+    options->calibration = NULL;
+    options->affinity = BATCHER_AFFINITY_NONE;
+    options->schedule = BATCHER_SCHEDULE_STEAL;
+    options->adaptive = false;
+}
+/* Функция для создания контекста: пул потоков создается один раз и ждет проходов на барьере
+   до уничтожения контекста, поэтому повторные сортировки не платят за создание потоков */
+batcher_context_t *batcher_context_create(const batcher_options_t *options) {
+    const simd_kernels_t *kernels = select_kernels(options->type, options->kernels);
+    if (!kernels) return NULL;
+    batcher_context_t *ctx = (batcher_context_t *)calloc(1, sizeof(batcher_context_t));
+    if (!ctx) return NULL;
+    int max_threads = options->max_threads > 1 ? options->max_threads : 1;
+    ctx->type = options->type;
+    ctx->config = (sort_config_t){ max_threads, tile_size_from(options->tile), options->pad, options->schedule, kernels,
+                                   NULL };
+    ctx->data.kernels = kernels;
+    ctx->data.adaptive = options->adaptive;
+    int cpu_count = 0;
+    if (options->affinity != BATCHER_AFFINITY_NONE && !options->executor) {
+        ctx->cpus = (int *)malloc(CPU_SETSIZE * sizeof(int));
+        if (ctx->cpus) cpu_count = cpu_order(options->affinity, ctx->cpus);
+        if (cpu_count == 0) print_stderr("Warning: CPU topology is unavailable, threads are not pinned\n");
+    }
+    double spawn_started = now_seconds();
+    if (!thread_pool_init(&ctx->pool, &ctx->data, max_threads, options->executor, ctx->cpus, cpu_count)) {
+        free(ctx->cpus);
+        free(ctx);
+        return NULL;
+    }
+    double spawned = now_seconds();
+    ctx->pool.steal = options->schedule == BATCHER_SCHEDULE_STEAL;
+    ctx->data.radix_counts = calloc((size_t)ctx->pool.size, sizeof(*ctx->data.radix_counts));
+    if (!ctx->data.radix_counts) {
+        thread_pool_destroy(&ctx->pool);
+        free(ctx->cpus);
+        free(ctx);
+        return NULL;
+    }
+    ctx->engine = options->engine;
+    ctx->register_max = DEFAULT_REGISTER_MAX;
+    ctx->radix_min = DEFAULT_RADIX_MIN;
+    /* Калибровка выполняется до подключения замеров, чтобы они учитывали только сортировки */
+    if (ctx->engine == BATCHER_ENGINE_AUTO && options->calibration && !calibration_load(ctx, options->calibration)) {
+        calibrate(ctx);
+        calibration_save(ctx, options->calibration);
+    }
+    batcher_stats_t *stats = options->stats;
+    if (stats) {
+        stats->busy = (double *)calloc((size_t)ctx->pool.size, sizeof(double));
+        if (stats->busy) {
+            stats->threads = ctx->pool.size;
+            stats->spawn += spawned - spawn_started;
+            ctx->config.stats = stats;
+            ctx->data.stats = stats;
+        } else {
+            print_stderr("Error: Memory allocation failed, stats disabled\n");
+        }
+    }
+    return ctx;
+}
+
+void batcher_context_destroy(batcher_context_t *ctx) {
+    if (!ctx) return;
+    double join_started = now_seconds();
+    thread_pool_destroy(&ctx->pool);
+    if (ctx->config.stats) ctx->config.stats->join += now_seconds() - join_started;
+    pad_pool_free(&ctx->pad_pool);
+    pad_pool_free(&ctx->radix_pool);
+    pad_pool_free(&ctx->ordered_pool);
+    free(ctx->data.radix_counts);
+    free(ctx->cpus);
+    free(ctx);
+}
+/* Функция для проверки упорядоченности массива долями потоков пула; малый массив
+   проверяется вызывающим потоком */
+static bool presorted(batcher_context_t *ctx, void *array, long n) {
+    thread_pool_t *pool = &ctx->pool;
+    double started = now_seconds();
+    ctx->data.array = array;
+    ctx->data.n = n;
+    atomic_store(&ctx->data.unsorted, false);
+    pool->pass.kind = PASS_CHECK;
+    pool->pass.local = 0;
+    thread_pool_run_pass(pool, n, CHECK_UNIT, false);
+    if (ctx->config.stats) ctx->config.stats->compute += now_seconds() - started;
+    return !atomic_load(&ctx->data.unsorted);
+}
+/* Функция для сортировки: ключи перекодируются в знаковые целые, сортируются выбранным алгоритмом
+   и перекодируются обратно. В адаптивном режиме уже отсортированный массив не сортируется */
+void batcher_sort(batcher_context_t *ctx, void *array, long n) {
+    double encode_started = now_seconds();
+    encode_keys(ctx->type, array, n);
+    double sort_started = now_seconds();
+    if (!ctx->data.adaptive || !presorted(ctx, array, n)) sort_with_engine(ctx, select_engine(ctx, n), array, n);
+    double decode_started = now_seconds();
+    decode_keys(ctx->type, array, n);
+    if (ctx->config.stats) {
+        ctx->config.stats->codec += (sort_started - encode_started) + (now_seconds() - decode_started);
+    }
+}
+
+/* Функция для заполнения нулями n элементов буфера долями потоков пула */
+static void touch_pass(batcher_context_t *ctx, void *buffer, long n) {
+    thread_pool_t *pool = &ctx->pool;
+    long page = TOUCH_PAGE_BYTES / (long)ctx->config.kernels->elem_size;
+    pool->pass.kind = PASS_TOUCH;
+    pool->pass.local = 0;
+    pool->pass.dst = buffer;
+    thread_pool_run_pass(pool, n, page, false);
+}
+/* Функция для первого касания: страница памяти размещается на узле NUMA потока, который первым
+   в нее пишет, поэтому массив и рабочие буферы заполняются потоками пула равными подряд идущими
+   долями. С ними точно совпадают доли поразрядной сортировки и, с точностью до плиток и блоков,
+   статического расписания сети. С захватом работы очереди потоков начинаются с тех же долей, но
+   захваченные порции и стадии выполняет поток, который их забрал, на страницах чужого узла */
+void batcher_first_touch(batcher_context_t *ctx, void *array, long n) {
+    if (n <= 0) return;
+    /* Касание не входит в замеры занятости потоков */
+    batcher_stats_t *stats = ctx->data.stats;
+    ctx->data.stats = NULL;
+    ctx->data.array = array;
+    ctx->data.n = n;
+    touch_pass(ctx, array, n);
+    size_t elem_size = ctx->config.kernels->elem_size;
+    batcher_engine_t engine = select_engine(ctx, n);
+    long padded = 1;
+    while (padded < n) padded *= 2;
+    if (engine == BATCHER_ENGINE_RADIX && pad_pool_reserve(&ctx->radix_pool, (size_t)n * elem_size)) {
+        touch_pass(ctx, ctx->radix_pool.data, n);
+    } else if (engine == BATCHER_ENGINE_NETWORK && ctx->config.pad == BATCHER_PAD_PHYSICAL && padded != n &&
+               pad_pool_reserve(&ctx->pad_pool, (size_t)padded * elem_size)) {
+        touch_pass(ctx, ctx->pad_pool.data, padded);
+    }
+    ctx->data.stats = stats;
+}
+
+const char *batcher_kernels_name(const batcher_context_t *ctx) {
+    return ctx->config.kernels->name;
+}
+
+batcher_type_t batcher_context_type(const batcher_context_t *ctx) {
+    return ctx->type;
+}
+
+int batcher_tile_size(const batcher_context_t *ctx) {
+    return ctx->config.tile;
+}
+
+batcher_engine_t batcher_select_engine(const batcher_context_t *ctx, long n) {
+    return select_engine(ctx, n);
+}
+
+const char *batcher_engine_name(batcher_engine_t engine) {
+    switch (engine) {
+        case BATCHER_ENGINE_REGISTER: return "register";
+        case BATCHER_ENGINE_NETWORK: return "network";
+        case BATCHER_ENGINE_RADIX: return "radix";
+        default: return "auto";
+    }
+}
+
+void batcher_thresholds(const batcher_context_t *ctx, long *register_max, long *radix_min) {
+    *register_max = ctx->register_max;
+    *radix_min = ctx->radix_min;
+}
+
+int batcher_supported_kernels(const char **names, int max) {
+    const simd_kernels_t *list[4];
+    int count = supported_kernels(BATCHER_INT32, list);
+    if (count > max) count = max;
+    for (int i = 0; i < count; i++) {
+        names[i] = list[i]->name;
+    }
+    return count;
+}
+
+bool batcher_is_sorted(batcher_type_t type, const void *array, long n) {
+    if (type == BATCHER_INT32) return is_sorted_int32(array, n);
+    if (type == BATCHER_INT64) return is_sorted_int64(array, n);
+    if (type == BATCHER_KV) return is_sorted_pair(array, n);
+    for (long i = 1; i < n; i++) {
+        if (total_order_key(type, array, i) < total_order_key(type, array, i - 1)) return false;
+    }
+    return true;
+}
+
+size_t batcher_type_size(batcher_type_t type) {
+    switch (type) {
+        case BATCHER_INT32: return sizeof(int32_t);
+        case BATCHER_FLOAT: return sizeof(float);
+        case BATCHER_DOUBLE: return sizeof(double);
+        case BATCHER_KV: return sizeof(batcher_kv_t);
+        default: return sizeof(int64_t);
+    }
+}
+
+void batcher_stats_free(batcher_stats_t *stats) {
+    free(stats->busy);
+    free(stats->passes);
+    stats->busy = NULL;
+    stats->passes = NULL;
+    stats->pass_count = 0;
+    stats->pass_capacity = 0;
+}
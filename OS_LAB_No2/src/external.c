@@ -0,0 +1,507 @@
+#define _GNU_SOURCE
+#include "batcher.h"
+
+#include <aio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BUF_SIZE 256
+/* Бюджет памяти по умолчанию */
+#define EXTERNAL_DEFAULT_MEMORY ((size_t)256 << 20)
+/* Наименьший буфер упреждающего чтения серии: меньшие буферы превращают слияние в случайное чтение */
+#define EXTERNAL_MIN_READ_BYTES ((size_t)1 << 16)
+
+static void print_stderr(const char *str) {
+    write(STDERR_FILENO, str, strlen(str));
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+/* Асинхронная передача буфера из файла или в файл через POSIX AIO. Короткая передача
+   дозапрашивается с места остановки, поэтому буфер любого размера передается целиком */
+typedef struct {
+    struct aiocb cb;
+    int fd;
+    char *buf;
+    off_t offset;
+    size_t bytes;
+    size_t done;
+    bool write;
+    bool busy;
+} async_io_t;
+/* Серия - отсортированный участок временного файла, в элементах */
+typedef struct {
+    long offset;
+    long length;
+} run_t;
+/* Источник слияния: серия, читаемая двумя буферами - из текущего берутся элементы,
+   во второй тем временем читается следующая часть серии */
+typedef struct {
+    char *buf[2];
+    int current;
+    long pos;
+    long fill;
+    /* Следующий элемент серии, который еще не запрошен, конец серии и число элементов в чтении */
+    long next;
+    long end;
+    long pending;
+    async_io_t read;
+    /* Ключ текущего элемента с тем же порядком, что и у сортировки */
+    uint64_t key;
+    bool done;
+} merge_source_t;
+/* Буферы k-путевого слияния, выделяемые один раз на все проходы */
+typedef struct {
+    batcher_type_t type;
+    size_t elem_size;
+    int fan_in;
+    merge_source_t *sources;
+    /* Дерево проигравших: tree[0] - победитель, tree[1..count) - проигравшие во внутренних узлах */
+    int *tree;
+    long read_elems;
+    char *out_buf[2];
+    async_io_t out_io[2];
+    int out_current;
+    long out_fill;
+    long out_elems;
+    long out_offset;
+} merger_t;
+
+/* Функция для запуска очередного запроса передачи */
+static bool async_submit(async_io_t *io) {
+    memset(&io->cb, 0, sizeof(io->cb));
+    io->cb.aio_fildes = io->fd;
+    io->cb.aio_buf = io->buf + io->done;
+    io->cb.aio_nbytes = io->bytes - io->done;
+    io->cb.aio_offset = io->offset + (off_t)io->done;
+    io->cb.aio_sigevent.sigev_notify = SIGEV_NONE;
+    if ((io->write ? aio_write(&io->cb) : aio_read(&io->cb)) != 0) {
+        print_stderr("Error: Failed to submit asynchronous I/O\n");
+        io->busy = false;
+        return false;
+    }
+    return true;
+}
+/* Функция для начала передачи bytes байт между buf и файлом fd со смещения offset */
+static bool async_start(async_io_t *io, int fd, void *buf, size_t bytes, off_t offset, bool write) {
+    io->fd = fd;
+    io->buf = (char *)buf;
+    io->offset = offset;
+    io->bytes = bytes;
+    io->done = 0;
+    io->write = write;
+    io->busy = bytes > 0;
+    return !io->busy || async_submit(io);
+}
+/* Функция для ожидания конца передачи; после нее буфер можно использовать, даже если передача не удалась */
+static bool async_wait(async_io_t *io) {
+    while (io->busy) {
+        const struct aiocb *list[1] = { &io->cb };
+        while (aio_error(&io->cb) == EINPROGRESS) {
+            aio_suspend(list, 1, NULL);
+        }
+        int error = aio_error(&io->cb);
+        ssize_t transferred = aio_return(&io->cb);
+        if (error != 0 || transferred <= 0) {
+            print_stderr(io->write ? "Error: Failed to write a sort file\n"
+                                   : "Error: Failed to read a sort file or it ended early\n");
+            io->busy = false;
+            return false;
+        }
+        io->done += (size_t)transferred;
+        if (io->done == io->bytes) {
+            io->busy = false;
+        } else if (!async_submit(io)) {
+            return false;
+        }
+    }
+    return true;
+}
+/* Функция для получения беззнакового ключа с порядком сортировки: у знаковых целых инвертируется
+   старший бит, у вещественных - полный порядок IEEE 754, у пар - ключ */
+static uint64_t order_key(batcher_type_t type, const void *elem) {
+    switch (type) {
+        case BATCHER_INT32: {
+            int32_t value;
+            memcpy(&value, elem, sizeof(value));
+            return (uint32_t)value ^ UINT32_C(0x80000000);
+        }
+        case BATCHER_FLOAT: {
+            uint32_t bits;
+            memcpy(&bits, elem, sizeof(bits));
+            return (bits & UINT32_C(0x80000000)) ? ~bits : bits | UINT32_C(0x80000000);
+        }
+        case BATCHER_INT64: {
+            int64_t value;
+            memcpy(&value, elem, sizeof(value));
+            return (uint64_t)value ^ (UINT64_C(1) << 63);
+        }
+        case BATCHER_DOUBLE: {
+            uint64_t bits;
+            memcpy(&bits, elem, sizeof(bits));
+            return (bits & (UINT64_C(1) << 63)) ? ~bits : bits | (UINT64_C(1) << 63);
+        }
+        case BATCHER_KV: {
+            batcher_kv_t pair;
+            memcpy(&pair, elem, sizeof(pair));
+            return pair.key;
+        }
+        default: {
+            uint64_t value;
+            memcpy(&value, elem, sizeof(value));
+            return value;
+        }
+    }
+}
+/* Функция для создания безымянного временного файла: он удаляется из каталога сразу
+   и исчезает вместе с последним дескриптором, в том числе при аварийном завершении */
+static int temp_file_open(const char *dir) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/batcher-XXXXXX", dir);
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        char buf[BUF_SIZE];
+        snprintf(buf, BUF_SIZE, "Error: cannot create a temporary file in %s\n", dir);
+        print_stderr(buf);
+        return -1;
+    }
+    unlink(path);
+    return fd;
+}
+
+static int output_open(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        char buf[BUF_SIZE];
+        snprintf(buf, BUF_SIZE, "Error: cannot create %s\n", path);
+        print_stderr(buf);
+    }
+    return fd;
+}
+/* Функция для чтения следующей части серии во второй буфер источника */
+static bool source_read_ahead(const merger_t *m, merge_source_t *s, int fd) {
+    long count = s->end - s->next < m->read_elems ? s->end - s->next : m->read_elems;
+    s->pending = count;
+    if (count == 0) return true;
+    size_t elem_size = m->elem_size;
+    bool ok = async_start(&s->read, fd, s->buf[1 - s->current], (size_t)count * elem_size,
+                          (off_t)s->next * (off_t)elem_size, false);
+    s->next += count;
+    return ok;
+}
+/* Функция для перехода к прочитанной части серии, когда текущий буфер исчерпан */
+static bool source_next_buffer(const merger_t *m, merge_source_t *s, int fd) {
+    if (s->pending == 0) {
+        s->done = true;
+        return true;
+    }
+    if (!async_wait(&s->read)) return false;
+    s->current = 1 - s->current;
+    s->fill = s->pending;
+    s->pos = 0;
+    s->key = order_key(m->type, s->buf[s->current]);
+    return source_read_ahead(m, s, fd);
+}
+/* Функция для сравнения источников: закончившийся проигрывает всем, равные ключи берутся
+   из серии с меньшим номером */
+static bool source_beats(const merger_t *m, int a, int b) {
+    const merge_source_t *x = &m->sources[a];
+    const merge_source_t *y = &m->sources[b];
+    if (x->done || y->done) return !x->done || (y->done && a < b);
+    if (x->key != y->key) return x->key < y->key;
+    return a < b;
+}
+/* Функция для проигрывания пути от листа leaf к корню. При построении пустой узел (-1) запоминает
+   пришедшего и останавливает подъем: дальше победитель поднимется, когда придет второй участник узла */
+static void tree_replay(merger_t *m, int count, int leaf) {
+    int winner = leaf;
+    for (int t = (leaf + count) / 2; t > 0; t /= 2) {
+        if (m->tree[t] < 0) {
+            m->tree[t] = winner;
+            return;
+        }
+        if (source_beats(m, m->tree[t], winner)) {
+            int loser = winner;
+            winner = m->tree[t];
+            m->tree[t] = loser;
+        }
+    }
+    m->tree[0] = winner;
+}
+/* Функция для записи заполненного выходного буфера; пока он пишется, заполняется второй,
+   предыдущая запись которого перед этим дожидается */
+static bool output_flush(merger_t *m, int fd) {
+    async_io_t *io = &m->out_io[m->out_current];
+    if (!async_start(io, fd, m->out_buf[m->out_current], (size_t)m->out_fill * m->elem_size,
+                     (off_t)m->out_offset * (off_t)m->elem_size, true)) {
+        return false;
+    }
+    m->out_offset += m->out_fill;
+    m->out_fill = 0;
+    m->out_current = 1 - m->out_current;
+    return async_wait(&m->out_io[m->out_current]);
+}
+/* Функция для слияния count серий файла src_fd в одну серию файла dst_fd, начиная с элемента dst_offset */
+static bool merge_group(merger_t *m, int src_fd, const run_t *runs, int count, int dst_fd, long dst_offset) {
+    size_t elem_size = m->elem_size;
+    bool ok = true;
+    for (int i = 0; i < count; i++) {
+        merge_source_t *s = &m->sources[i];
+        s->current = 1;
+        s->pos = 0;
+        s->fill = 0;
+        s->next = runs[i].offset;
+        s->end = runs[i].offset + runs[i].length;
+        s->done = false;
+        s->read.busy = false;
+        ok = ok && source_read_ahead(m, s, src_fd);
+    }
+    for (int i = 0; i < count && ok; i++) {
+        ok = source_next_buffer(m, &m->sources[i], src_fd);
+    }
+    for (int t = 1; t < count; t++) {
+        m->tree[t] = -1;
+    }
+    for (int i = 0; i < count && ok; i++) {
+        tree_replay(m, count, i);
+    }
+    m->out_current = 0;
+    m->out_fill = 0;
+    m->out_offset = dst_offset;
+    m->out_io[0].busy = false;
+    m->out_io[1].busy = false;
+    while (ok && !m->sources[m->tree[0]].done) {
+        int winner = m->tree[0];
+        merge_source_t *s = &m->sources[winner];
+        memcpy(m->out_buf[m->out_current] + (size_t)m->out_fill * elem_size,
+               s->buf[s->current] + (size_t)s->pos * elem_size, elem_size);
+        if (++m->out_fill == m->out_elems) ok = output_flush(m, dst_fd);
+        if (++s->pos < s->fill) {
+            s->key = order_key(m->type, s->buf[s->current] + (size_t)s->pos * elem_size);
+        } else if (ok) {
+            ok = source_next_buffer(m, s, src_fd);
+        }
+        tree_replay(m, count, winner);
+    }
+    if (ok && m->out_fill > 0) ok = output_flush(m, dst_fd);
+    /* Буферы переиспользуются следующей группой только после конца всех передач */
+    for (int i = 0; i < count; i++) {
+        if (!async_wait(&m->sources[i].read)) ok = false;
+    }
+    for (int b = 0; b < 2; b++) {
+        if (!async_wait(&m->out_io[b])) ok = false;
+    }
+    return ok;
+}
+/* Функция для выделения буферов слияния: четверть бюджета - на два выходных буфера, остальное -
+   на пары буферов чтения серий. Число одновременно сливаемых серий ограничено так, чтобы буфер
+   чтения был не меньше EXTERNAL_MIN_READ_BYTES */
+static bool merger_init(merger_t *m, batcher_type_t type, size_t memory, long run_count) {
+    size_t elem_size = batcher_type_size(type);
+    size_t read_memory = memory - memory / 4;
+    long max_fan_in = (long)(read_memory / (2 * EXTERNAL_MIN_READ_BYTES));
+    if (max_fan_in < 2) max_fan_in = 2;
+    if (max_fan_in > INT_MAX / 2) max_fan_in = INT_MAX / 2;
+    m->type = type;
+    m->elem_size = elem_size;
+    m->fan_in = (int)(run_count < max_fan_in ? run_count : max_fan_in);
+    m->read_elems = (long)(read_memory / (2 * (size_t)m->fan_in) / elem_size);
+    m->out_elems = (long)(memory / 8 / elem_size);
+    if (m->read_elems < 1) m->read_elems = 1;
+    if (m->out_elems < 1) m->out_elems = 1;
+    m->sources = (merge_source_t *)calloc((size_t)m->fan_in, sizeof(merge_source_t));
+    m->tree = (int *)malloc((size_t)m->fan_in * sizeof(int));
+    m->out_buf[0] = (char *)malloc((size_t)m->out_elems * elem_size);
+    m->out_buf[1] = (char *)malloc((size_t)m->out_elems * elem_size);
+    bool ok = m->sources && m->tree && m->out_buf[0] && m->out_buf[1];
+    for (int i = 0; ok && i < m->fan_in; i++) {
+        for (int b = 0; b < 2 && ok; b++) {
+            m->sources[i].buf[b] = (char *)malloc((size_t)m->read_elems * elem_size);
+            ok = m->sources[i].buf[b] != NULL;
+        }
+    }
+    if (!ok) print_stderr("Error: Memory allocation failed\n");
+    return ok;
+}
+
+static void merger_free(merger_t *m) {
+    for (int i = 0; m->sources && i < m->fan_in; i++) {
+        free(m->sources[i].buf[0]);
+        free(m->sources[i].buf[1]);
+    }
+    free(m->sources);
+    free(m->tree);
+    free(m->out_buf[0]);
+    free(m->out_buf[1]);
+}
+/* Функция для слияния серий: пока серий больше, чем помещается в одно слияние, группы соседних серий
+   сливаются во второй временный файл на то же место (серии группы лежат подряд), и файлы меняются
+   ролями. Последний проход пишет в выходной файл */
+static bool merge_all(batcher_type_t type, size_t memory, const char *temp_dir, int temp_fd, run_t *runs,
+                      long run_count, const char *output, int *passes) {
+    merger_t m;
+    memset(&m, 0, sizeof(m));
+    if (!merger_init(&m, type, memory, run_count)) {
+        merger_free(&m);
+        return false;
+    }
+    int src_fd = temp_fd;
+    int spare_fd = -1;
+    bool ok = true;
+    while (ok && run_count > m.fan_in) {
+        if (spare_fd < 0) spare_fd = temp_file_open(temp_dir);
+        if (spare_fd < 0) {
+            ok = false;
+            break;
+        }
+        long groups = 0;
+        for (long first = 0; first < run_count && ok; first += m.fan_in) {
+            int count = (int)(run_count - first < m.fan_in ? run_count - first : m.fan_in);
+            run_t merged = { runs[first].offset, 0 };
+            for (int i = 0; i < count; i++) {
+                merged.length += runs[first + i].length;
+            }
+            ok = merge_group(&m, src_fd, runs + first, count, spare_fd, merged.offset);
+            runs[groups++] = merged;
+        }
+        run_count = groups;
+        int swap = src_fd;
+        src_fd = spare_fd;
+        spare_fd = swap;
+        (*passes)++;
+    }
+    if (ok) {
+        int out_fd = output_open(output);
+        ok = out_fd >= 0 && merge_group(&m, src_fd, runs, (int)run_count, out_fd, 0);
+        if (out_fd >= 0 && close(out_fd) != 0) ok = false;
+        (*passes)++;
+    }
+    /* Исходный временный файл закрывает вызывающая функция */
+    if (src_fd != temp_fd) close(src_fd);
+    if (spare_fd >= 0 && spare_fd != temp_fd) close(spare_fd);
+    merger_free(&m);
+    return ok;
+}
+
+void batcher_external_options_init(batcher_external_options_t *options) {
+    options->memory = EXTERNAL_DEFAULT_MEMORY;
+    options->temp_dir = NULL;
+}
+/* Функция для внешней сортировки. Серии строятся конвейером из трех буферов: пока пул контекста
+   сортирует серию i, серия i + 1 читается, а серия i - 1 пишется во временный файл */
+bool batcher_sort_file(batcher_context_t *ctx, const char *input, const char *output,
+                       const batcher_external_options_t *options, batcher_external_stats_t *stats) {
+    char buf[BUF_SIZE];
+    batcher_type_t type = batcher_context_type(ctx);
+    size_t elem_size = batcher_type_size(type);
+    const char *temp_dir = options->temp_dir;
+    if (!temp_dir) temp_dir = getenv("TMPDIR");
+    if (!temp_dir || !*temp_dir) temp_dir = "/tmp";
+    double started = now_seconds();
+    int in_fd = open(input, O_RDONLY);
+    struct stat st;
+    if (in_fd < 0 || fstat(in_fd, &st) != 0 || (size_t)st.st_size % elem_size != 0) {
+        snprintf(buf, BUF_SIZE, "Error: cannot open %s or its size is not a multiple of %zu\n", input, elem_size);
+        print_stderr(buf);
+        if (in_fd >= 0) close(in_fd);
+        return false;
+    }
+    long n = (long)((size_t)st.st_size / elem_size);
+    /* Три буфера серий и память алгоритма сортировки (второй буфер радикса или дополнения) */
+    long chunk = (long)(options->memory / 4 / elem_size);
+    if (chunk > INT_MAX) chunk = INT_MAX;
+    if (chunk < 1) chunk = 1;
+    if (chunk > n) chunk = n > 0 ? n : 1;
+    long run_count = (n + chunk - 1) / chunk;
+    int buffers = run_count > 1 ? 3 : 1;
+    char *chunks[3] = { NULL, NULL, NULL };
+    bool ok = true;
+    for (int b = 0; b < buffers && ok; b++) {
+        chunks[b] = (char *)malloc((size_t)chunk * elem_size);
+        ok = chunks[b] != NULL;
+    }
+    run_t *runs = (run_t *)malloc((size_t)(run_count > 0 ? run_count : 1) * sizeof(run_t));
+    if (!ok || !runs) {
+        print_stderr("Error: Memory allocation failed\n");
+        for (int b = 0; b < 3; b++) free(chunks[b]);
+        free(runs);
+        close(in_fd);
+        return false;
+    }
+    /* Буферы касаются потоки пула, чтобы их страницы оказались на узлах NUMA сортирующих потоков */
+    for (int b = 0; b < buffers; b++) {
+        batcher_first_touch(ctx, chunks[b], chunk);
+    }
+    /* Одна серия: сортировка в памяти без временного файла */
+    int temp_fd = run_count > 1 ? temp_file_open(temp_dir) : -1;
+    ok = run_count <= 1 || temp_fd >= 0;
+    async_io_t reads[3];
+    async_io_t writes[3];
+    for (int b = 0; b < 3; b++) {
+        reads[b].busy = false;
+        writes[b].busy = false;
+    }
+    for (long i = 0; i < run_count; i++) {
+        runs[i].offset = i * chunk;
+        runs[i].length = n - runs[i].offset < chunk ? n - runs[i].offset : chunk;
+    }
+    if (ok && run_count > 0) {
+        ok = async_start(&reads[0], in_fd, chunks[0], (size_t)runs[0].length * elem_size, 0, false);
+    }
+    for (long i = 0; i < run_count && ok; i++) {
+        int b = (int)(i % 3);
+        ok = async_wait(&reads[b]);
+        if (ok && i + 1 < run_count) {
+            /* Буфер следующей серии освобождается, когда допишется серия i - 2 */
+            int next = (int)((i + 1) % 3);
+            ok = async_wait(&writes[next]) &&
+                 async_start(&reads[next], in_fd, chunks[next], (size_t)runs[i + 1].length * elem_size,
+                             (off_t)runs[i + 1].offset * (off_t)elem_size, false);
+        }
+        if (!ok) break;
+        batcher_sort(ctx, chunks[b], runs[i].length);
+        if (run_count > 1) {
+            ok = async_start(&writes[b], temp_fd, chunks[b], (size_t)runs[i].length * elem_size,
+                             (off_t)runs[i].offset * (off_t)elem_size, true);
+        }
+    }
+    for (int b = 0; b < 3; b++) {
+        if (!async_wait(&reads[b])) ok = false;
+        if (!async_wait(&writes[b])) ok = false;
+    }
+    close(in_fd);
+    double runs_done = now_seconds();
+    int passes = 0;
+    if (ok && run_count <= 1) {
+        /* Входной файл уже прочитан, поэтому выходной может с ним совпадать */
+        int out_fd = output_open(output);
+        ok = out_fd >= 0;
+        if (ok && n > 0) {
+            ok = async_start(&writes[0], out_fd, chunks[0], (size_t)n * elem_size, 0, true) && async_wait(&writes[0]);
+        }
+        if (out_fd >= 0 && close(out_fd) != 0) ok = false;
+    }
+    for (int b = 0; b < 3; b++) free(chunks[b]);
+    if (ok && run_count > 1) {
+        ok = merge_all(type, options->memory, temp_dir, temp_fd, runs, run_count, output, &passes);
+    }
+    if (temp_fd >= 0) close(temp_fd);
+    free(runs);
+    if (stats) {
+        stats->runs = run_count;
+        stats->merge_passes = passes;
+        stats->run_seconds = runs_done - started;
+        stats->merge_seconds = now_seconds() - runs_done;
+    }
+    return ok;
+}
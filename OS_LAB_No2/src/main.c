@@ -1,12 +1,27 @@
+#define _POSIX_C_SOURCE 200809L
+#include "batcher.h"
+
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <stdbool.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <errno.h>
 
 #define BUF_SIZE 256
+/* Число элементов, форматируемых одним потоком за раз, и максимальная длина одного элемента */
+#define FORMAT_CHUNK_ELEMENTS 65536
+#define FORMAT_ELEMENT_CHARS 48
+/* Максимальное число потоков форматирования (не больше IOV_MAX буферов в одном writev) */
+#define FORMAT_MAX_THREADS 64
 
 /* Вспомогательные функции для вывода */
 static void print_stdout(const char *str) {
@@ -16,225 +31,1116 @@ static void print_stdout(const char *str) {
 static void print_stderr(const char *str) {
     write(STDERR_FILENO, str, strlen(str));
 }
+/* Формат вывода замеров */
+typedef enum {
+    STATS_NONE,
+    STATS_TEXT,
+    STATS_CSV,
+    STATS_JSON
+} stats_format_t;
+/* Файл с массивом, отображенный в память */
+typedef struct {
+    void *data;
+    size_t bytes;
+} file_map_t;
+
+static const char *elem_type_name(batcher_type_t type) {
+    switch (type) {
+        case BATCHER_INT64: return "int64";
+        case BATCHER_UINT64: return "uint64";
+        case BATCHER_FLOAT: return "float";
+        case BATCHER_DOUBLE: return "double";
+        case BATCHER_KV: return "kv";
+        default: return "int32";
+    }
+}
+
+static bool parse_elem_type(const char *str, batcher_type_t *type) {
+    for (int t = BATCHER_INT32; t <= BATCHER_KV; t++) {
+        if (strcmp(str, elem_type_name((batcher_type_t)t)) == 0) {
+            *type = (batcher_type_t)t;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_engine(const char *str, batcher_engine_t *engine) {
+    for (int e = BATCHER_ENGINE_AUTO; e <= BATCHER_ENGINE_RADIX; e++) {
+        if (strcmp(str, batcher_engine_name((batcher_engine_t)e)) == 0) {
+            *engine = (batcher_engine_t)e;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *affinity_name(batcher_affinity_t affinity) {
+    switch (affinity) {
+        case BATCHER_AFFINITY_COMPACT: return "compact";
+        case BATCHER_AFFINITY_SCATTER: return "scatter";
+        default: return "none";
+    }
+}
+
+static bool parse_affinity(const char *str, batcher_affinity_t *affinity) {
+    for (int a = BATCHER_AFFINITY_NONE; a <= BATCHER_AFFINITY_SCATTER; a++) {
+        if (strcmp(str, affinity_name((batcher_affinity_t)a)) == 0) {
+            *affinity = (batcher_affinity_t)a;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *schedule_name(batcher_schedule_t schedule) {
+    return schedule == BATCHER_SCHEDULE_STATIC ? "static" : "steal";
+}
+
+static uint64_t random_u64(void) {
+    return ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand();
+}
+/* Функция для генерации i-го элемента массива типа type */
+static void generate_element(batcher_type_t type, void *array, long i) {
+    switch (type) {
+        case BATCHER_INT32: ((int32_t *)array)[i] = rand() % 10000; break;
+        case BATCHER_INT64: ((int64_t *)array)[i] = (int64_t)(random_u64() - (UINT64_C(1) << 62)); break;
+        case BATCHER_UINT64: ((uint64_t *)array)[i] = random_u64(); break;
+        case BATCHER_FLOAT: ((float *)array)[i] = (float)(rand() % 20001 - 10000) / 8.0f; break;
+        case BATCHER_DOUBLE: ((double *)array)[i] = ((double)rand() / RAND_MAX - 0.5) * 1e6; break;
+        case BATCHER_KV:
+            ((batcher_kv_t *)array)[i].key = random_u64() % 10000;
+            ((batcher_kv_t *)array)[i].id = (uint64_t)i;
+            break;
+    }
+}
+
+/* Порядок генерируемого массива */
+typedef enum {
+    ORDER_RANDOM,
+    ORDER_SORTED,
+    /* Возрастающий, каждый сотый элемент случайный */
+    ORDER_NEARLY,
+    /* Возрастающий с дописанным в конец случайным хвостом из 1% элементов, как у журнала */
+    ORDER_APPENDED
+} input_order_t;
 
-/* Структуры данных для хранения данных о сортировке */
+static const char *order_name(input_order_t order) {
+    switch (order) {
+        case ORDER_SORTED: return "sorted";
+        case ORDER_NEARLY: return "nearly";
+        case ORDER_APPENDED: return "appended";
+        default: return "random";
+    }
+}
+
+static bool parse_order(const char *str, input_order_t *order) {
+    for (int o = ORDER_RANDOM; o <= ORDER_APPENDED; o++) {
+        if (strcmp(str, order_name((input_order_t)o)) == 0) {
+            *order = (input_order_t)o;
+            return true;
+        }
+    }
+    return false;
+}
+/* Функция для генерации i-го элемента возрастающего массива из n элементов в диапазоне значений generate_element */
+static void generate_sorted_element(batcher_type_t type, void *array, long i, long n) {
+    switch (type) {
+        case BATCHER_INT32: ((int32_t *)array)[i] = (int32_t)(i * 10000 / n); break;
+        case BATCHER_INT64: ((int64_t *)array)[i] = (int64_t)i - n / 2; break;
+        case BATCHER_UINT64: ((uint64_t *)array)[i] = (uint64_t)i; break;
+        case BATCHER_FLOAT: ((float *)array)[i] = (float)(i * 20001 / n - 10000) / 8.0f; break;
+        case BATCHER_DOUBLE: ((double *)array)[i] = ((double)i / n - 0.5) * 1e6; break;
+        case BATCHER_KV:
+            ((batcher_kv_t *)array)[i].key = (uint64_t)(i * 10000 / n);
+            ((batcher_kv_t *)array)[i].id = (uint64_t)i;
+            break;
+    }
+}
+
+/* Пары десятичных цифр 00..99 для перевода числа в строку по две цифры за деление */
+static const char digit_pairs[] =
+    "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+    "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+/* Функция для записи десятичного представления value в out; возвращает конец записи */
+static char *format_u64(char *out, uint64_t value) {
+    char digits[20];
+    char *p = digits + sizeof(digits);
+    while (value >= 100) {
+        const char *pair = digit_pairs + (value % 100) * 2;
+        value /= 100;
+        *--p = pair[1];
+        *--p = pair[0];
+    }
+    if (value >= 10) {
+        *--p = digit_pairs[value * 2 + 1];
+        *--p = digit_pairs[value * 2];
+    } else {
+        *--p = (char)('0' + value);
+    }
+    size_t length = (size_t)(digits + sizeof(digits) - p);
+    memcpy(out, p, length);
+    return out + length;
+}
+
+static char *format_i64(char *out, int64_t value) {
+    if (value < 0) {
+        *out++ = '-';
+        return format_u64(out, -(uint64_t)value);
+    }
+    return format_u64(out, (uint64_t)value);
+}
+/* Функция для записи i-го элемента в out; возвращает конец записи */
+static char *format_element(char *out, batcher_type_t type, const void *array, long i) {
+    switch (type) {
+        case BATCHER_INT32: return format_i64(out, ((const int32_t *)array)[i]);
+        case BATCHER_INT64: return format_i64(out, ((const int64_t *)array)[i]);
+        case BATCHER_UINT64: return format_u64(out, ((const uint64_t *)array)[i]);
+        case BATCHER_FLOAT: return out + snprintf(out, FORMAT_ELEMENT_CHARS, "%g", (double)((const float *)array)[i]);
+        case BATCHER_DOUBLE: return out + snprintf(out, FORMAT_ELEMENT_CHARS, "%g", ((const double *)array)[i]);
+        case BATCHER_KV:
+            out = format_u64(out, ((const batcher_kv_t *)array)[i].key);
+            *out++ = ':';
+            return format_u64(out, ((const batcher_kv_t *)array)[i].id);
+    }
+    return out;
+}
+/* Участок массива [first, last), форматируемый одним потоком в свой буфер */
 typedef struct {
-    int *array;
-    int n;
-    int max_threads;
-    int active_threads;
-    pthread_mutex_t *mutex;
-} sort_data_t;
-/* Структура для хранения данных о потоке */
+    batcher_type_t type;
+    const void *array;
+    long first;
+    long last;
+    char *text;
+    size_t length;
+} format_chunk_t;
+
+static void format_chunk(format_chunk_t *chunk) {
+    char *out = chunk->text;
+    for (long i = chunk->first; i < chunk->last; i++) {
+        out = format_element(out, chunk->type, chunk->array, i);
+        *out++ = ' ';
+    }
+    chunk->length = (size_t)(out - chunk->text);
+}
+/* Потоки форматирования одного вывода: создаются один раз и ждут раундов на условной переменной.
+   Раунд начинается увеличением round, pending - число потоков, еще форматирующих свой участок */
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long round;
+    int pending;
+    bool shutdown;
+    format_chunk_t chunk[FORMAT_MAX_THREADS];
+} format_pool_t;
+
 typedef struct {
-    sort_data_t *data;
-    int start;
-    int end;
-    int step;
-} thread_data_t;
-/* Функция для сравнения и обмена значениями */
-static void compare_swap(int *a, int *b) {
-    if (*a > *b) {
-        int temp = *a;
-        *a = *b;
-        *b = temp;
-    }
-}
-/* Функция для слияния двух подмассивов */
-static void *batcher_merge_thread(void *arg) {
-    thread_data_t *tdata = (thread_data_t *)arg;
-    sort_data_t *data = tdata->data;
-    /* Блокировка мьютекса для активных потоков */
-    pthread_mutex_lock(data->mutex);
-    data->active_threads++;
-    pthread_mutex_unlock(data->mutex);
-    /* Слияние двух подмассивов */
-    for (int i = tdata->start; i < tdata->end; i += tdata->step) {
-        if (i + tdata->step / 2 < data->n) {
-            compare_swap(&data->array[i], &data->array[i + tdata->step / 2]);
-        }
-    }
-    /* Разблокировка мьютекса для активных потоков */
-    pthread_mutex_lock(data->mutex);
-    data->active_threads--;
-    pthread_mutex_unlock(data->mutex);
-    /* Возвращение NULL */
+    format_pool_t *pool;
+    int index;
+} format_worker_t;
+
+static void *format_worker(void *arg) {
+    format_worker_t *worker = (format_worker_t *)arg;
+    format_pool_t *pool = worker->pool;
+    unsigned long seen = 0;
+    while (true) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->round == seen && !pool->shutdown) {
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        }
+        seen = pool->round;
+        bool shutdown = pool->shutdown;
+        pthread_mutex_unlock(&pool->mutex);
+        if (shutdown) break;
+        format_chunk(&pool->chunk[worker->index]);
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->pending == 0) pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->mutex);
+    }
     return NULL;
 }
-/* Функция для слияния двух подмассивов */
-static void batcher_merge(int *array, int n, int step, sort_data_t *data) {
-    int num_operations = 0;
-    for (int i = 0; i < n - step / 2; i += step) {
-        num_operations++;
-    }
-    /* Если количество операций равно 0, то выход */
-    if (num_operations == 0) return;
-    /* Определение количества потоков для использования */
-    int threads_to_use = data->max_threads;
-    if (threads_to_use > num_operations) {
-        threads_to_use = num_operations;
-    }
-    /* Если количество потоков равно 1, то выполняем слияние без использования потоков */
-    if (threads_to_use <= 1) {
-        for (int i = 0; i < n - step / 2; i += step) {
-            if (i + step / 2 < n) {
-                compare_swap(&array[i], &array[i + step / 2]);
-            }
+/* Функция для записи всех буферов одним writev с дозаписью при частичной записи */
+static bool write_all(struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(STDOUT_FILENO, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
         }
-        return;
     }
-    /* Определение количества операций на один поток */
-    int operations_per_thread = (num_operations + threads_to_use - 1) / threads_to_use;
-    /* Выделение памяти для потоков */
-    pthread_t *threads = (pthread_t *)malloc(threads_to_use * sizeof(pthread_t));
-    /* Выделение памяти для данных о потоке */
-    thread_data_t *tdata_array = (thread_data_t *)malloc(threads_to_use * sizeof(thread_data_t));
+    return true;
+}
+/* Функция для вывода n элементов массива. Массив выводится раундами: в каждом раунде
+   до max_threads потоков форматируют подряд идущие участки в свои переиспользуемые буферы,
+   после чего буферы выводятся по порядку одним системным вызовом writev. Потоки создаются
+   один раз на весь вывод, а массив из одного участка форматируется без них.
+   Буферы рассчитаны на участок, но не больше чем на n элементов */
+static void print_array(batcher_type_t type, const void *array, long n, int max_threads) {
+    long chunk_elements = n < FORMAT_CHUNK_ELEMENTS ? n : FORMAT_CHUNK_ELEMENTS;
+    if (chunk_elements < 1) chunk_elements = 1;
+    long chunks = (n + chunk_elements - 1) / chunk_elements;
+    int workers = max_threads < FORMAT_MAX_THREADS ? max_threads : FORMAT_MAX_THREADS;
+    if (workers > chunks) workers = (int)chunks;
+    if (workers < 1) workers = 1;
     
-    if (!threads || !tdata_array) {
+    size_t chunk_bytes = (size_t)chunk_elements * (FORMAT_ELEMENT_CHARS + 1);
+    char *text = malloc((size_t)workers * chunk_bytes);
+    if (!text) {
         print_stderr("Error: Memory allocation failed\n");
-        free(threads);
-        free(tdata_array);
         return;
     }
-    
-    int thread_count = 0;
-
-    for (int t = 0; t < threads_to_use; t++) {
-        int start = t * operations_per_thread * step;
-        int end = (t + 1) * operations_per_thread * step;
-        if (end > n) end = n;
-        /* Если начало больше или равно концу, то выход */
-        if (start >= n - step / 2) break;
-        /* Заполнение данных для потока */
-        tdata_array[thread_count].data = data;
-        tdata_array[thread_count].start = start;
-        tdata_array[thread_count].end = end;
-        tdata_array[thread_count].step = step;
-        /* Создание потока*/
-        if (pthread_create(&threads[thread_count], NULL, batcher_merge_thread, &tdata_array[thread_count]) == 0) {
-            thread_count++;
-        }
-    }
-    /* Ожидание завершения всех потоков */
-    for (int i = 0; i < thread_count; i++) {
-        pthread_join(threads[i], NULL);
-    }
-    /* Освобождение памяти */
-    free(threads);
-    free(tdata_array);
-}
-/* Функция для четно-нечетной сортировки Бетчера */
-static void batcher_odd_even_sort(int *array, int n, int max_threads) {
-    if (n <= 1) return;
-    /* Инициализация мьютекса */
-    pthread_mutex_t mutex;
-    /* Если не удалось инициализировать мьютекс, то выход */
-    if (pthread_mutex_init(&mutex, NULL) != 0) {
-        print_stderr("Error: Failed to initialize mutex\n");
-        return;
+    format_pool_t pool = { .round = 0, .pending = 0, .shutdown = false };
+    format_worker_t worker[FORMAT_MAX_THREADS];
+    pthread_t threads[FORMAT_MAX_THREADS];
+    /* Первый участок раунда форматирует вызывающий поток; участки несозданных потоков - тоже он */
+    int started = 1;
+    if (workers > 1) {
+        pthread_mutex_init(&pool.mutex, NULL);
+        pthread_cond_init(&pool.start, NULL);
+        pthread_cond_init(&pool.done, NULL);
+        for (; started < workers; started++) {
+            worker[started] = (format_worker_t){ &pool, started };
+            if (pthread_create(&threads[started], NULL, format_worker, &worker[started]) != 0) break;
+        }
     }
-    /* Заполнение данных для сортировки */
-    sort_data_t data = {
-        .array = array,
-        .n = n,
-        .max_threads = max_threads,
-        .active_threads = 0,
-        .mutex = &mutex
-    };
-    
-    /* Цикл для выполнения четно-нечетной сортировки Бетчера */
-    for (int step = 2; step <= n; step *= 2) {
-        /* Цикл для выполнения слияния */
-        for (int substep = step; substep >= 2; substep /= 2) {
-            batcher_merge(array, n, substep, &data);
+    format_chunk_t *chunk = pool.chunk;
+    struct iovec iov[FORMAT_MAX_THREADS];
+    for (long first = 0; first < n; first += (long)workers * chunk_elements) {
+        int count = 0;
+        for (long start = first; count < workers; start += chunk_elements) {
+            long last = n - start > chunk_elements ? start + chunk_elements : n;
+            if (start > n) start = last = n;
+            chunk[count] = (format_chunk_t){ type, array, start, last, text + (size_t)count * chunk_bytes, 0 };
+            count++;
+        }
+        if (started > 1) {
+            pthread_mutex_lock(&pool.mutex);
+            pool.pending = started - 1;
+            pool.round++;
+            pthread_cond_broadcast(&pool.start);
+            pthread_mutex_unlock(&pool.mutex);
+        }
+        format_chunk(&chunk[0]);
+        for (int i = started; i < count; i++) {
+            format_chunk(&chunk[i]);
+        }
+        if (started > 1) {
+            pthread_mutex_lock(&pool.mutex);
+            while (pool.pending > 0) {
+                pthread_cond_wait(&pool.done, &pool.mutex);
+            }
+            pthread_mutex_unlock(&pool.mutex);
+        }
+        /* Участки после конца массива пусты и в вывод не попадают */
+        while (count > 1 && chunk[count - 1].length == 0) count--;
+        for (int i = 0; i < count; i++) {
+            iov[i].iov_base = chunk[i].text;
+            iov[i].iov_len = chunk[i].length;
+        }
+        if (chunk[count - 1].last == n) {
+            chunk[count - 1].text[chunk[count - 1].length - 1] = '\n';
+        }
+        if (!write_all(iov, count)) {
+            print_stderr("Error: failed to write array\n");
+            break;
         }
     }
-    
-    pthread_mutex_destroy(&mutex);
+    if (workers > 1) {
+        pthread_mutex_lock(&pool.mutex);
+        pool.shutdown = true;
+        pthread_cond_broadcast(&pool.start);
+        pthread_mutex_unlock(&pool.mutex);
+        for (int i = 1; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        pthread_mutex_destroy(&pool.mutex);
+        pthread_cond_destroy(&pool.start);
+        pthread_cond_destroy(&pool.done);
+    }
+    free(text);
 }
+/* Функция для отображения существующего файла в память. С writable изменения попадают в файл,
+   иначе файл только читается */
+static bool file_map_open(file_map_t *map, const char *path, bool writable) {
+    char buf[BUF_SIZE];
+    map->data = NULL;
+    map->bytes = 0;
+    int fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        snprintf(buf, BUF_SIZE, "Error: cannot open %s\n", path);
+        print_stderr(buf);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        snprintf(buf, BUF_SIZE, "Error: %s is empty or not a regular file\n", path);
+        print_stderr(buf);
+        close(fd);
+        return false;
+    }
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *data = mmap(NULL, (size_t)st.st_size, prot, writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        snprintf(buf, BUF_SIZE, "Error: cannot map %s\n", path);
+        print_stderr(buf);
+        return false;
+    }
+    map->data = data;
+    map->bytes = (size_t)st.st_size;
+    return true;
+}
+/* Функция для создания файла размером bytes и отображения его в память для записи */
+static bool file_map_create(file_map_t *map, const char *path, size_t bytes) {
+    char buf[BUF_SIZE];
+    map->data = NULL;
+    map->bytes = 0;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)bytes) != 0) {
+        snprintf(buf, BUF_SIZE, "Error: cannot create %s\n", path);
+        print_stderr(buf);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        snprintf(buf, BUF_SIZE, "Error: cannot map %s\n", path);
+        print_stderr(buf);
+        return false;
+    }
+    map->data = data;
+    map->bytes = bytes;
+    return true;
+}
+
+static void file_map_close(file_map_t *map) {
+    if (map->data) munmap(map->data, map->bytes);
+    map->data = NULL;
+}
+static int compare_ints(const void *a, const void *b) {
+    int32_t x = *(const int32_t *)a;
+    int32_t y = *(const int32_t *)b;
+    return (x > y) - (x < y);
+}
+/* Проверяемые алгоритмы: сеть с обоими способами дополнения, сеть в одном потоке и радикс.
+   Ненулевые tile и threads заменяют заданные в командной строке: с маленькой плиткой и
+   несколькими потоками блоков стадий хватает, чтобы стадии выполнялись целиком без барьеров */
+typedef struct {
+    batcher_engine_t engine;
+    batcher_pad_t pad;
+    batcher_schedule_t schedule;
+    bool adaptive;
+    int tile;
+    int threads;
+    const char *name;
+} self_test_variant_t;
 
-static void print_array(int *array, int n) {
+static const self_test_variant_t self_test_variants[] = {
+    { BATCHER_ENGINE_NETWORK, BATCHER_PAD_VIRTUAL, BATCHER_SCHEDULE_STEAL, false, 0, 0, "network with virtual padding" },
+    { BATCHER_ENGINE_NETWORK, BATCHER_PAD_VIRTUAL, BATCHER_SCHEDULE_STATIC, false, 0, 0, "network with static schedule" },
+    { BATCHER_ENGINE_NETWORK, BATCHER_PAD_PHYSICAL, BATCHER_SCHEDULE_STEAL, false, 0, 0, "network with physical padding" },
+    { BATCHER_ENGINE_NETWORK, BATCHER_PAD_VIRTUAL, BATCHER_SCHEDULE_STEAL, false, 64, 4, "network with whole-stage passes" },
+    { BATCHER_ENGINE_NETWORK, BATCHER_PAD_VIRTUAL, BATCHER_SCHEDULE_STEAL, true, 0, 0, "adaptive network" },
+    { BATCHER_ENGINE_NETWORK, BATCHER_PAD_VIRTUAL, BATCHER_SCHEDULE_STATIC, true, 0, 0, "adaptive network with static schedule" },
+    { BATCHER_ENGINE_REGISTER, BATCHER_PAD_VIRTUAL, BATCHER_SCHEDULE_STEAL, false, 0, 0, "single-thread network" },
+    { BATCHER_ENGINE_RADIX, BATCHER_PAD_VIRTUAL, BATCHER_SCHEDULE_STEAL, false, 0, 0, "radix" }
+};
+#define SELF_TEST_VARIANTS (int)(sizeof(self_test_variants) / sizeof(self_test_variants[0]))
+/* Функция для создания контекста самопроверки; kernels - имя набора ядер или NULL */
+static batcher_context_t *self_test_context(batcher_type_t type, const char *kernels, int max_threads, int tile,
+                                            const self_test_variant_t *variant) {
+    batcher_options_t options;
+    batcher_options_init(&options);
+    options.type = type;
+    options.kernels = kernels;
+    options.max_threads = variant->threads > 0 ? variant->threads : max_threads;
+    options.tile = variant->tile > 0 ? variant->tile : tile;
+    options.pad = variant->pad;
+    options.engine = variant->engine;
+    options.schedule = variant->schedule;
+    options.adaptive = variant->adaptive;
+    batcher_context_t *ctx = batcher_context_create(&options);
+    if (!ctx) print_stderr("Error: Failed to create sort context\n");
+    return ctx;
+}
+/* Функция для суммы 32-битных слов массива: перестановка элементов ее не меняет,
+   а ошибка перекодирования ключей меняет */
+static uint32_t array_checksum(batcher_type_t type, const void *array, long n) {
+    size_t words = (size_t)n * batcher_type_size(type) / sizeof(uint32_t);
+    uint32_t sum = 0;
+    for (size_t i = 0; i < words; i++) {
+        uint32_t word;
+        memcpy(&word, (const char *)array + i * sizeof(word), sizeof(word));
+        sum += word;
+    }
+    return sum;
+}
+/* Функция для проверки float, 64-битных ядер и ядер пар на случайных входах. Среди float
+   есть -0, NaN обоих знаков и отрицательные значения, которые проверяют полный порядок IEEE 754 */
+static bool self_test_typed(int max_threads, int tile) {
     char buf[BUF_SIZE];
-    for (int i = 0; i < n; i++) {
-        snprintf(buf, BUF_SIZE, "%d ", array[i]);
-        print_stdout(buf);
+    const batcher_type_t types[] = { BATCHER_FLOAT, BATCHER_INT64, BATCHER_UINT64, BATCHER_DOUBLE, BATCHER_KV };
+    const uint32_t float_specials[] = { UINT32_C(0x80000000), UINT32_C(0x7fc00000), UINT32_C(0xffc00000) };
+    int max_n = 4096;
+    void *array = malloc((size_t)max_n * sizeof(batcher_kv_t));
+    if (!array) {
+        print_stderr("Error: Memory allocation failed\n");
+        return false;
     }
-    print_stdout("\n");
+    bool ok = true;
+    for (size_t t = 0; t < sizeof(types) / sizeof(types[0]) && ok; t++) {
+        for (int v = 0; v < SELF_TEST_VARIANTS && ok; v++) {
+            const self_test_variant_t *variant = &self_test_variants[v];
+            batcher_context_t *ctx = self_test_context(types[t], NULL, max_threads, tile, variant);
+            if (!ctx) {
+                ok = false;
+                break;
+            }
+            srand(2);
+            for (int n = 1; n <= max_n && ok; n += 1 + n / 8) {
+                for (int i = 0; i < n; i++) {
+                    generate_element(types[t], array, i);
+                    int special = rand() % 16;
+                    if (types[t] == BATCHER_FLOAT && special < 3) {
+                        memcpy((float *)array + i, &float_specials[special], sizeof(float));
+                    }
+                }
+                uint32_t checksum = array_checksum(types[t], array, n);
+                batcher_sort(ctx, array, n);
+                if (!batcher_is_sorted(types[t], array, n) || array_checksum(types[t], array, n) != checksum) {
+                    snprintf(buf, BUF_SIZE, "FAIL: %s elements, %s, random input of size %d\n",
+                             elem_type_name(types[t]), variant->name, n);
+                    print_stdout(buf);
+                    ok = false;
+                }
+            }
+            batcher_context_destroy(ctx);
+            if (ok) {
+                snprintf(buf, BUF_SIZE, "OK: %s elements, %s, random inputs\n",
+                         elem_type_name(types[t]), variant->name);
+                print_stdout(buf);
+            }
+        }
+    }
+    free(array);
+    return ok;
 }
-/* Функция для проверки, является ли массив отсортированным */
-static bool is_sorted(int *array, int n) {
-    for (int i = 1; i < n; i++) {
-        if (array[i] < array[i - 1]) {
-            return false;
+/* Функция для самопроверки сети с каждым набором ядер и обоими способами дополнения.
+   По принципу 0-1 сеть сравнений сортирует любые входы тогда и только тогда,
+   когда она сортирует все последовательности из нулей и единиц, поэтому для
+   n <= max_n перебираются все 2^n таких входов. Большие n, где работают
+   векторные проходы, проверяются сравнением со стандартной сортировкой */
+static bool self_test(int max_n, int max_threads, int tile) {
+    char buf[BUF_SIZE];
+    const char *names[4];
+    int kernel_count = batcher_supported_kernels(names, 4);
+    int random_n = 4096;
+    int32_t *array = (int32_t *)malloc((size_t)random_n * sizeof(int32_t));
+    int32_t *expected = (int32_t *)malloc((size_t)random_n * sizeof(int32_t));
+    if (!array || !expected) {
+        print_stderr("Error: Memory allocation failed\n");
+        free(array);
+        free(expected);
+        return false;
+    }
+    bool ok = true;
+    for (int kc = 0; kc < kernel_count && ok; kc++) {
+        for (int v = 0; v < SELF_TEST_VARIANTS && ok; v++) {
+            const self_test_variant_t *variant = &self_test_variants[v];
+            batcher_context_t *ctx = self_test_context(BATCHER_INT32, names[kc], max_threads, tile, variant);
+            if (!ctx) {
+                ok = false;
+                break;
+            }
+            for (int n = 1; n <= max_n && ok; n++) {
+                for (long mask = 0; mask < (1L << n) && ok; mask++) {
+                    int ones = 0;
+                    for (int i = 0; i < n; i++) {
+                        array[i] = (int32_t)((mask >> i) & 1);
+                        ones += array[i];
+                    }
+                    batcher_sort(ctx, array, n);
+                    int sum = 0;
+                    for (int i = 0; i < n; i++) sum += array[i];
+                    if (!batcher_is_sorted(BATCHER_INT32, array, n) || sum != ones) {
+                        snprintf(buf, BUF_SIZE, "FAIL: %s kernels, %s, n = %d, input mask %ld\n",
+                                 names[kc], variant->name, n, mask);
+                        print_stdout(buf);
+                        ok = false;
+                    }
+                }
+            }
+            srand(1);
+            /* Четные размеры - случайные входы, нечетные - почти отсортированные, на которых
+               адаптивный режим пропускает блоки */
+            for (int n = max_n + 1; n <= random_n && ok; n += 1 + n / 16) {
+                for (int i = 0; i < n; i++) {
+                    bool ordered = n % 2 == 1 && rand() % 64 != 0;
+                    array[i] = expected[i] = ordered ? i * 100 / n - 50 : rand() % 100 - 50;
+                }
+                qsort(expected, (size_t)n, sizeof(int32_t), compare_ints);
+                batcher_sort(ctx, array, n);
+                if (memcmp(array, expected, (size_t)n * sizeof(int32_t)) != 0) {
+                    snprintf(buf, BUF_SIZE, "FAIL: %s kernels, %s, random input of size %d\n",
+                             names[kc], variant->name, n);
+                    print_stdout(buf);
+                    ok = false;
+                }
+            }
+            batcher_context_destroy(ctx);
+            if (ok) {
+                snprintf(buf, BUF_SIZE, "OK: %s kernels, %s, all 0-1 inputs up to n = %d\n",
+                         names[kc], variant->name, max_n);
+                print_stdout(buf);
+            }
+        }
+    }
+    free(array);
+    free(expected);
+    return ok && self_test_typed(max_threads, tile);
+}
+
+/* Функция для получения времени по монотонным часам в секундах */
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void print_fd(int fd, const char *str) {
+    write(fd, str, strlen(str));
+}
+/* Функция для вывода замеров сортировки n элементов: wall - время сортировки целиком
+   вместе с перекодированием ключей, kernels, tile и engine - выбранные контекстом ядра, плитка и алгоритм */
+static void print_stats(int fd, stats_format_t format, const batcher_options_t *options, const char *kernels,
+                        int tile, batcher_engine_t engine, long n, double wall, bool header) {
+    char buf[BUF_SIZE];
+    const batcher_stats_t *stats = options->stats;
+    const char *pad = options->pad == BATCHER_PAD_VIRTUAL ? "virtual" : "physical";
+    const char *type = elem_type_name(options->type);
+    double codec = stats->codec;
+    double busy_min = 0.0, busy_max = 0.0, busy_sum = 0.0;
+    for (int t = 0; t < stats->threads; t++) {
+        double busy = stats->busy[t];
+        if (t == 0 || busy < busy_min) busy_min = busy;
+        if (t == 0 || busy > busy_max) busy_max = busy;
+        busy_sum += busy;
+    }
+    double busy_avg = stats->threads > 0 ? busy_sum / stats->threads : 0.0;
+    
+    if (format == STATS_CSV) {
+        if (header) {
+            print_fd(fd, "n,type,max_threads,pool_threads,kernels,tile,padding,engine,wall,spawn,compute,join,"
+                         "padding_copy,codec,busy_min,busy_avg,busy_max,schedule,steals,adaptive,skipped\n");
         }
+        snprintf(buf, BUF_SIZE, "%ld,%s,%d,%d,%s,%d,%s,%s,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%s,%ld,%d,%ld\n",
+                 n, type, options->max_threads, stats->threads, kernels, tile, pad, batcher_engine_name(engine),
+                 wall, stats->spawn, stats->compute, stats->join, stats->padding, codec, busy_min, busy_avg, busy_max,
+                 schedule_name(options->schedule), stats->steals, options->adaptive, stats->skipped);
+        print_fd(fd, buf);
+        return;
     }
+    if (format == STATS_JSON) {
+        snprintf(buf, BUF_SIZE, "{\"n\": %ld, \"type\": \"%s\", \"max_threads\": %d, \"pool_threads\": %d, "
+                 "\"kernels\": \"%s\", \"tile\": %d, \"padding\": \"%s\", \"engine\": \"%s\", ",
+                 n, type, options->max_threads, stats->threads, kernels, tile, pad, batcher_engine_name(engine));
+        print_fd(fd, buf);
+        snprintf(buf, BUF_SIZE, "\"wall\": %.9f, \"spawn\": %.9f, \"compute\": %.9f, \"join\": %.9f, "
+                 "\"padding_copy\": %.9f, \"codec\": %.9f, \"schedule\": \"%s\", \"steals\": %ld, "
+                 "\"adaptive\": %s, \"skipped\": %ld, \"busy\": [",
+                 wall, stats->spawn, stats->compute, stats->join, stats->padding, codec,
+                 schedule_name(options->schedule), stats->steals, options->adaptive ? "true" : "false", stats->skipped);
+        print_fd(fd, buf);
+        for (int t = 0; t < stats->threads; t++) {
+            snprintf(buf, BUF_SIZE, "%s%.9f", t ? ", " : "", stats->busy[t]);
+            print_fd(fd, buf);
+        }
+        print_fd(fd, "], \"passes\": [");
+        for (long i = 0; i < stats->pass_count; i++) {
+            const batcher_pass_time_t *pass = &stats->passes[i];
+            snprintf(buf, BUF_SIZE, "%s{\"p\": %ld, \"k\": %ld, \"seconds\": %.9f}",
+                     i ? ", " : "", pass->p, pass->k, pass->seconds);
+            print_fd(fd, buf);
+        }
+        print_fd(fd, "]}\n");
+        return;
+    }
+    snprintf(buf, BUF_SIZE, "Wall time: %.6f s (spawn %.6f, compute %.6f, join %.6f, padding copy %.6f), "
+             "key encoding %.6f s\n", wall, stats->spawn, stats->compute, stats->join, stats->padding, codec);
+    print_fd(fd, buf);
+    snprintf(buf, BUF_SIZE, "Thread busy time (%d threads): min %.6f, avg %.6f, max %.6f s\n",
+             stats->threads, busy_min, busy_avg, busy_max);
+    print_fd(fd, buf);
+    for (int t = 0; t < stats->threads; t++) {
+        double share = stats->compute > 0.0 ? 100.0 * stats->busy[t] / stats->compute : 0.0;
+        snprintf(buf, BUF_SIZE, "  thread %d: busy %.6f s (%.1f%% of compute)\n", t, stats->busy[t], share);
+        print_fd(fd, buf);
+    }
+    snprintf(buf, BUF_SIZE, "Work stealing (%s schedule): %ld chunks stolen\n", schedule_name(options->schedule),
+             stats->steals);
+    print_fd(fd, buf);
+    if (options->adaptive) {
+        snprintf(buf, BUF_SIZE, "Adaptive: %ld ordered tiles and stage blocks skipped\n", stats->skipped);
+        print_fd(fd, buf);
+    }
+    /* Проходы одной стадии p суммируются */
+    print_fd(fd, "Stage times:\n");
+    for (long i = 0; i < stats->pass_count;) {
+        const batcher_pass_time_t *pass = &stats->passes[i];
+        if (pass->k == 0) {
+            snprintf(buf, BUF_SIZE, "  local sort of %ld-element blocks: %.6f s\n", pass->p, pass->seconds);
+            print_fd(fd, buf);
+            i++;
+            continue;
+        }
+        if (pass->k < 0) {
+            snprintf(buf, BUF_SIZE, "  p = %ld: all passes in %ld-element blocks, %.6f s\n", pass->p, 2 * pass->p,
+                     pass->seconds);
+            print_fd(fd, buf);
+            i++;
+            continue;
+        }
+        long passes = 0;
+        double seconds = 0.0;
+        long p = pass->p;
+        for (; i < stats->pass_count && stats->passes[i].p == p && stats->passes[i].k > 0; i++) {
+            passes++;
+            seconds += stats->passes[i].seconds;
+        }
+        snprintf(buf, BUF_SIZE, "  p = %ld: %ld passes, %.6f s\n", p, passes, seconds);
+        print_fd(fd, buf);
+    }
+}
+
+/* Функция для разбора размера с необязательным суффиксом K, M или G */
+static bool parse_size(const char *str, size_t *size) {
+    char *end;
+    unsigned long long value = strtoull(str, &end, 10);
+    int shift = 0;
+    if (*end == 'K' || *end == 'k') {
+        shift = 10;
+    } else if (*end == 'M' || *end == 'm') {
+        shift = 20;
+    } else if (*end == 'G' || *end == 'g') {
+        shift = 30;
+    }
+    if (shift) end++;
+    if (end == str || *end != '\0' || value == 0 || value > (SIZE_MAX >> shift)) return false;
+    *size = (size_t)value << shift;
     return true;
 }
-/* Функция для вывода массива */
+/* Функция для внешней сортировки файла, который может не помещаться в память */
+static int external_main(const batcher_options_t *options, const char *input_path, const char *output_path,
+                         const batcher_external_options_t *external) {
+    char buf[BUF_SIZE];
+    batcher_context_t *ctx = batcher_context_create(options);
+    if (!ctx) {
+        print_stderr("Error: Failed to create sort context\n");
+        return EXIT_FAILURE;
+    }
+    const char *kernels = batcher_kernels_name(ctx);
+    if (!output_path) output_path = input_path;
+    snprintf(buf, BUF_SIZE, "External sort of %s elements from %s with %zu bytes of memory, %s kernels\n",
+             elem_type_name(options->type), input_path, external->memory, kernels);
+    print_stdout(buf);
+    batcher_external_stats_t stats;
+    double start = now_seconds();
+    bool ok = batcher_sort_file(ctx, input_path, output_path, external, &stats);
+    double time_taken = now_seconds() - start;
+    batcher_context_destroy(ctx);
+    if (!ok) return EXIT_FAILURE;
+    /* Проверка отображением только для чтения: страницы выходного файла подгружаются по мере проверки.
+       Пустой файл не отображается и считается отсортированным, а любая другая ошибка отображения -
+       провалом проверки */
+    file_map_t output = { NULL, 0 };
+    bool sorted = false;
+    long n = 0;
+    struct stat st;
+    if (stat(output_path, &st) == 0 && S_ISREG(st.st_mode) && st.st_size == 0) {
+        sorted = true;
+    } else if (file_map_open(&output, output_path, false)) {
+        n = (long)(output.bytes / batcher_type_size(options->type));
+        sorted = batcher_is_sorted(options->type, output.data, n);
+        file_map_close(&output);
+    }
+    snprintf(buf, BUF_SIZE, "Sorted %ld elements written to %s\n", n, output_path);
+    print_stdout(buf);
+    snprintf(buf, BUF_SIZE, "Array is %s\n", sorted ? "sorted correctly" : "NOT sorted correctly");
+    print_stdout(buf);
+    snprintf(buf, BUF_SIZE, "Time taken: %.6f seconds (wall clock): runs %.6f, merge %.6f\n", time_taken,
+             stats.run_seconds, stats.merge_seconds);
+    print_stdout(buf);
+    snprintf(buf, BUF_SIZE, "Runs: %ld, merge passes: %d\n", stats.runs, stats.merge_passes);
+    print_stdout(buf);
+    snprintf(buf, BUF_SIZE, "Max threads used: %d\n", options->max_threads);
+    print_stdout(buf);
+    return sorted ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char *argv[]) {
     char buf[BUF_SIZE];
+    const char *program = argv[0];
+    int tile = BATCHER_DEFAULT_TILE;
+    batcher_pad_t pad = BATCHER_PAD_VIRTUAL;
+    batcher_engine_t engine = BATCHER_ENGINE_AUTO;
+    const char *calibration_path = NULL;
+    batcher_affinity_t affinity = BATCHER_AFFINITY_NONE;
+    bool first_touch = false;
+    batcher_schedule_t schedule = BATCHER_SCHEDULE_STEAL;
+    bool adaptive = false;
+    input_order_t order = ORDER_RANDOM;
+    batcher_type_t type = BATCHER_INT32;
+    const char *input_path = NULL;
+    const char *output_path = NULL;
+    bool print_all = false;
+    stats_format_t stats_format = STATS_NONE;
+    const char *stats_path = NULL;
+    int self_test_n = 0;
+    bool external = false;
+    batcher_external_options_t external_options;
+    batcher_external_options_init(&external_options);
+    /* Разбор опций, указанных перед позиционными параметрами */
+    while (argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+        if (strncmp(argv[1], "--tile=", 7) == 0) {
+            tile = atoi(argv[1] + 7);
+        } else if (strcmp(argv[1], "--pad=virtual") == 0) {
+            pad = BATCHER_PAD_VIRTUAL;
+        } else if (strcmp(argv[1], "--pad=physical") == 0) {
+            pad = BATCHER_PAD_PHYSICAL;
+        } else if (strncmp(argv[1], "--engine=", 9) == 0) {
+            if (!parse_engine(argv[1] + 9, &engine)) {
+                snprintf(buf, BUF_SIZE, "Error: unknown engine %s\n", argv[1] + 9);
+                print_stderr(buf);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[1], "--affinity=", 11) == 0) {
+            if (!parse_affinity(argv[1] + 11, &affinity)) {
+                snprintf(buf, BUF_SIZE, "Error: unknown affinity %s\n", argv[1] + 11);
+                print_stderr(buf);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[1], "--schedule=steal") == 0) {
+            schedule = BATCHER_SCHEDULE_STEAL;
+        } else if (strcmp(argv[1], "--schedule=static") == 0) {
+            schedule = BATCHER_SCHEDULE_STATIC;
+        } else if (strcmp(argv[1], "--first-touch") == 0) {
+            first_touch = true;
+        } else if (strcmp(argv[1], "--adaptive") == 0) {
+            adaptive = true;
+        } else if (strncmp(argv[1], "--order=", 8) == 0) {
+            if (!parse_order(argv[1] + 8, &order)) {
+                snprintf(buf, BUF_SIZE, "Error: unknown input order %s\n", argv[1] + 8);
+                print_stderr(buf);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[1], "--calibration=", 14) == 0) {
+            calibration_path = argv[1] + 14;
+        } else if (strncmp(argv[1], "--type=", 7) == 0) {
+            if (!parse_elem_type(argv[1] + 7, &type)) {
+                snprintf(buf, BUF_SIZE, "Error: unknown element type %s\n", argv[1] + 7);
+                print_stderr(buf);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[1], "--input=", 8) == 0) {
+            input_path = argv[1] + 8;
+        } else if (strncmp(argv[1], "--output=", 9) == 0) {
+            output_path = argv[1] + 9;
+        } else if (strcmp(argv[1], "--external") == 0) {
+            external = true;
+        } else if (strncmp(argv[1], "--memory=", 9) == 0) {
+            if (!parse_size(argv[1] + 9, &external_options.memory)) {
+                snprintf(buf, BUF_SIZE, "Error: invalid memory size %s\n", argv[1] + 9);
+                print_stderr(buf);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[1], "--temp-dir=", 11) == 0) {
+            external_options.temp_dir = argv[1] + 11;
+        } else if (strncmp(argv[1], "--stats=", 8) == 0) {
+            const char *format = argv[1] + 8;
+            if (strcmp(format, "text") == 0) {
+                stats_format = STATS_TEXT;
+            } else if (strcmp(format, "csv") == 0) {
+                stats_format = STATS_CSV;
+            } else if (strcmp(format, "json") == 0) {
+                stats_format = STATS_JSON;
+            } else {
+                snprintf(buf, BUF_SIZE, "Error: unknown stats format %s\n", format);
+                print_stderr(buf);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[1], "--stats-file=", 13) == 0) {
+            stats_path = argv[1] + 13;
+        } else if (strcmp(argv[1], "--print-all") == 0) {
+            print_all = true;
+        } else if (strncmp(argv[1], "--self-test=", 12) == 0) {
+            self_test_n = atoi(argv[1] + 12);
+            if (self_test_n < 1 || self_test_n > 24) {
+                print_stderr("Error: self-test size must be between 1 and 24\n");
+                return EXIT_FAILURE;
+            }
+        } else {
+            snprintf(buf, BUF_SIZE, "Error: unknown option %s\n", argv[1]);
+            print_stderr(buf);
+            return EXIT_FAILURE;
+        }
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    }
+    
+    if (self_test_n > 0 && argc >= 2) {
+        bool passed = self_test(self_test_n, atoi(argv[1]) > 0 ? atoi(argv[1]) : 1, tile);
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
     
-    if (argc < 3) {
-        snprintf(buf, BUF_SIZE, "Usage: %s <max_threads> <array_size> [seed]\n", argv[0]);
+    if (argc < (input_path ? 2 : 3)) {
+        snprintf(buf, BUF_SIZE, "Usage: %s [options] <max_threads> <array_size> [seed]\n", program);
+        print_stderr(buf);
+        snprintf(buf, BUF_SIZE, "       %s [options] --input=FILE <max_threads>\n", program);
+        print_stderr(buf);
+        snprintf(buf, BUF_SIZE, "Example: %s 4 1000\n", program);
         print_stderr(buf);
-        snprintf(buf, BUF_SIZE, "Example: %s 4 1000\n", argv[0]);
+        print_stderr("  --tile=N: sort N-element tiles in cache before merging them (0 disables)\n");
+        print_stderr("  --pad=virtual|physical: treat missing elements up to a power of two as +inf\n");
+        print_stderr("      without extra memory (default) or copy into a padded buffer\n");
+        print_stderr("  --engine=auto|register|network|radix: sorting algorithm (default auto: single-thread\n");
+        print_stderr("      network for small arrays, radix for large ones, the thread pool network in between)\n");
+        print_stderr("  --calibration=FILE: per-machine thresholds for --engine=auto; measured and appended\n");
+        print_stderr("      to FILE on the first run with these kernels, element size and thread count\n");
+        print_stderr("  --affinity=none|compact|scatter: pin pool threads filling NUMA nodes one by one\n");
+        print_stderr("      or round-robin across nodes (default none)\n");
+        print_stderr("  --schedule=steal|static: split network passes into chunks that idle threads steal and run\n");
+        print_stderr("      stages with enough blocks without barriers (default), or one equal share per thread\n");
+        print_stderr("  --adaptive: return at once on sorted input and skip tiles and stage blocks already in order\n");
+        print_stderr("  --order=random|sorted|nearly|appended: generated input; nearly is sorted with every 100th\n");
+        print_stderr("      element random, appended is sorted with a random 1% tail\n");
+        print_stderr("  --first-touch: zero the generated array and sort buffers from the pool threads\n");
+        print_stderr("      before filling it, so each thread's share is placed on its NUMA node\n");
+        print_stderr("      (shares match the sort exactly with --schedule=static; stolen work runs remotely)\n");
+        print_stderr("  --type=int32|int64|uint64|float|double|kv: element type (default int32);\n");
+        print_stderr("      float/double use IEEE total order, kv is a 64-bit key with a 64-bit id\n");
+        print_stderr("  --input=FILE: sort a raw binary file of --type elements in place via mmap\n");
+        print_stderr("  --output=FILE: write the sorted array to a raw binary file via mmap\n");
+        print_stderr("      (with --input the input file is left unchanged)\n");
+        print_stderr("  --external: sort the --input file in memory-sized runs merged from temporary files,\n");
+        print_stderr("      for files larger than memory (in place unless --output is given)\n");
+        print_stderr("  --memory=SIZE: memory budget of --external with a K, M or G suffix (default 256M)\n");
+        print_stderr("  --temp-dir=DIR: directory for --external temporary files (default $TMPDIR or /tmp)\n");
+        print_stderr("  --print-all: print whole arrays instead of the first 20 elements\n");
+        print_stderr("  --stats=text|csv|json: report wall time per stage, pool spawn/join and per-thread busy time\n");
+        print_stderr("  --stats-file=FILE: append the report to FILE instead of stdout (CSV header once)\n");
+        snprintf(buf, BUF_SIZE, "  --self-test=N: check all 0-1 inputs up to size N, then exit (%s --self-test=12 4)\n", program);
         print_stderr(buf);
         return EXIT_FAILURE;
     }
     /* Преобразование строки в целое число */
     /* atoi - функция для преобразования строки в целое число */
     int max_threads = atoi(argv[1]);
-    int array_size = atoi(argv[2]);
-    int seed = (argc > 3) ? atoi(argv[3]) : (int)time(NULL);
+    long array_size = input_path ? 0 : atol(argv[2]);
+    int seed = (!input_path && argc > 3) ? atoi(argv[3]) : (int)time(NULL);
+    size_t elem_size = batcher_type_size(type);
     
     if (max_threads < 1) {
         print_stderr("Error: max_threads must be at least 1\n");
         return EXIT_FAILURE;
     }
+    /* Внешняя сортировка не отображает файл целиком, поэтому размер файла не ограничен памятью */
+    if (external) {
+        if (!input_path) {
+            print_stderr("Error: --external requires --input\n");
+            return EXIT_FAILURE;
+        }
+        batcher_options_t options;
+        batcher_options_init(&options);
+        options.type = type;
+        options.max_threads = max_threads;
+        options.tile = tile;
+        options.pad = pad;
+        options.engine = engine;
+        options.calibration = calibration_path;
+        options.affinity = affinity;
+        options.schedule = schedule;
+        options.adaptive = adaptive;
+        return external_main(&options, input_path, output_path, &external_options);
+    }
+    /* Входной файл: размер массива определяется размером файла. Без --output файл
+       сортируется на месте, иначе копируется в отображение выходного файла */
+    file_map_t input = { NULL, 0 };
+    file_map_t output = { NULL, 0 };
+    if (input_path) {
+        if (!file_map_open(&input, input_path, output_path == NULL)) return EXIT_FAILURE;
+        if (input.bytes % elem_size != 0 || input.bytes / elem_size > LONG_MAX) {
+            snprintf(buf, BUF_SIZE, "Error: size of %s is not a multiple of %zu or too large\n", input_path, elem_size);
+            print_stderr(buf);
+            file_map_close(&input);
+            return EXIT_FAILURE;
+        }
+        array_size = (long)(input.bytes / elem_size);
+    }
     
-    if (array_size < 1) {
-        print_stderr("Error: array_size must be at least 1\n");
+    /* Сортировка принимает long n, поэтому размер ограничен только адресуемой памятью */
+    if (array_size < 1 || (size_t)array_size > SIZE_MAX / elem_size) {
+        print_stderr("Error: array_size must be at least 1 and fit in memory\n");
         return EXIT_FAILURE;
     }
     
-    int *array = (int *)malloc(array_size * sizeof(int));
+    void *array;
+    if (output_path) {
+        if (!file_map_create(&output, output_path, (size_t)array_size * elem_size)) {
+            file_map_close(&input);
+            return EXIT_FAILURE;
+        }
+        array = output.data;
+    } else if (input_path) {
+        array = input.data;
+    } else {
+        array = malloc((size_t)array_size * elem_size);
+    }
     if (!array) {
         print_stderr("Error: Memory allocation failed\n");
         return EXIT_FAILURE;
     }
-    /* Генерация массива */
-    srand(seed);
-    snprintf(buf, BUF_SIZE, "Generating array of size %d with seed %d\n", array_size, seed);
-    print_stdout(buf);
-    for (int i = 0; i < array_size; i++) {
-        array[i] = rand() % 10000;
+    bool file_mode = input_path || output_path;
+    
+    /* Замеры по монотонным часам: clock() суммирует процессорное время всех потоков
+       и не показывает ускорение параллельной сортировки */
+    batcher_stats_t stats = { 0 };
+    batcher_options_t options;
+    batcher_options_init(&options);
+    options.type = type;
+    options.max_threads = max_threads;
+    options.tile = tile;
+    options.pad = pad;
+    options.stats = stats_format != STATS_NONE ? &stats : NULL;
+    options.engine = engine;
+    options.calibration = calibration_path;
+    options.affinity = affinity;
+    options.schedule = schedule;
+    options.adaptive = adaptive;
+    batcher_context_t *ctx = batcher_context_create(&options);
+    if (!ctx) {
+        print_stderr("Error: Failed to create sort context\n");
+        if (output_path) file_map_close(&output);
+        if (input_path) file_map_close(&input);
+        if (!file_mode) free(array);
+        return EXIT_FAILURE;
+    }
+    /* Первое касание до генерации: иначе все страницы массива оказались бы на узле главного потока */
+    if (first_touch && !input_path) {
+        batcher_first_touch(ctx, array, array_size);
     }
     
-    print_stdout("Original array (first 20 elements): ");
-    print_array(array, array_size < 20 ? array_size : 20);
+    if (input_path) {
+        if (output_path) {
+            memcpy(array, input.data, input.bytes);
+            file_map_close(&input);
+        }
+        snprintf(buf, BUF_SIZE, "Mapped %ld %s elements from %s\n", array_size, elem_type_name(type), input_path);
+        print_stdout(buf);
+    } else {
+        /* Генерация массива */
+        srand(seed);
+        snprintf(buf, BUF_SIZE, "Generating %s %s array of size %ld with seed %d\n", order_name(order),
+                 elem_type_name(type), array_size, seed);
+        print_stdout(buf);
+        for (long i = 0; i < array_size; i++) {
+            bool random = order == ORDER_RANDOM || (order == ORDER_NEARLY && i % 100 == 0) ||
+                          (order == ORDER_APPENDED && i >= array_size - array_size / 100);
+            if (!random) {
+                generate_sorted_element(type, array, i, array_size);
+            } else {
+                generate_element(type, array, i);
+            }
+        }
+    }
     
-    clock_t start = clock();
-    batcher_odd_even_sort(array, array_size, max_threads);
-    clock_t end = clock();
+    /* Сколько элементов выводить до и после сортировки */
+    long shown = print_all ? array_size : (array_size < 20 ? array_size : 20);
+    if (!file_mode) {
+        print_stdout(print_all ? "Original array: " : "Original array (first 20 elements): ");
+        print_array(type, array, shown, max_threads);
+    }
     
-    double time_taken = ((double)(end - start)) / CLOCKS_PER_SEC;
+    if (options.stats && !stats.busy) stats_format = STATS_NONE;
+    const char *kernels = batcher_kernels_name(ctx);
+    tile = batcher_tile_size(ctx);
+    engine = batcher_select_engine(ctx, array_size);
+    long register_max, radix_min;
+    batcher_thresholds(ctx, &register_max, &radix_min);
+    double start = now_seconds();
+    batcher_sort(ctx, array, array_size);
+    double time_taken = now_seconds() - start;
+    /* Потоки пула завершаются до вывода, чтобы в замеры попало время их завершения */
+    batcher_context_destroy(ctx);
+    bool sorted = batcher_is_sorted(type, array, array_size);
     
-    print_stdout("Sorted array (first 20 elements): ");
-    print_array(array, array_size < 20 ? array_size : 20);
+    if (!file_mode) {
+        print_stdout(print_all ? "Sorted array: " : "Sorted array (first 20 elements): ");
+        print_array(type, array, shown, max_threads);
+    } else {
+        snprintf(buf, BUF_SIZE, "Sorted array written to %s\n", output_path ? output_path : input_path);
+        print_stdout(buf);
+    }
     
-    bool sorted = is_sorted(array, array_size);
     snprintf(buf, BUF_SIZE, "Array is %s\n", sorted ? "sorted correctly" : "NOT sorted correctly");
     print_stdout(buf);
-    snprintf(buf, BUF_SIZE, "Time taken: %.6f seconds\n", time_taken);
+    snprintf(buf, BUF_SIZE, "Time taken: %.6f seconds (wall clock)\n", time_taken);
     print_stdout(buf);
     snprintf(buf, BUF_SIZE, "Max threads used: %d\n", max_threads);
     print_stdout(buf);
+    snprintf(buf, BUF_SIZE, "SIMD kernels: %s\n", kernels);
+    print_stdout(buf);
+    snprintf(buf, BUF_SIZE, "Tile size: %d\n", tile);
+    print_stdout(buf);
+    snprintf(buf, BUF_SIZE, "Padding: %s\n", pad == BATCHER_PAD_VIRTUAL ? "virtual" : "physical");
+    print_stdout(buf);
+    snprintf(buf, BUF_SIZE, "Affinity: %s%s\n", affinity_name(affinity), first_touch ? ", first touch" : "");
+    print_stdout(buf);
+    if (options.engine == BATCHER_ENGINE_AUTO) {
+        snprintf(buf, BUF_SIZE, "Engine: %s (single-thread up to %ld, radix from %ld%s)\n", batcher_engine_name(engine),
+                 register_max, radix_min, calibration_path ? ", calibrated" : ", default thresholds");
+    } else {
+        snprintf(buf, BUF_SIZE, "Engine: %s\n", batcher_engine_name(engine));
+    }
+    print_stdout(buf);
     print_stdout("\nTo verify thread count, use:\n");
     snprintf(buf, BUF_SIZE, "  ps -eLf | grep %s | wc -l\n", argv[0]);
     print_stdout(buf);
     snprintf(buf, BUF_SIZE, "  top -H -p $(pgrep -f %s)\n", argv[0]);
     print_stdout(buf);
+    if (stats_format != STATS_NONE) {
+        int fd = STDOUT_FILENO;
+        if (stats_path) {
+            fd = open(stats_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (fd < 0) {
+                snprintf(buf, BUF_SIZE, "Error: cannot open %s, printing stats to stdout\n", stats_path);
+                print_stderr(buf);
+                fd = STDOUT_FILENO;
+            }
+        }
+        bool header = fd == STDOUT_FILENO || lseek(fd, 0, SEEK_END) == 0;
+        print_stats(fd, stats_format, &options, kernels, tile, engine, array_size, time_taken, header);
+        if (fd != STDOUT_FILENO) close(fd);
+    }
+    batcher_stats_free(&stats);
     
-    free(array);
+    if (output_path) {
+        file_map_close(&output);
+    } else if (input_path) {
+        file_map_close(&input);
+    } else {
+        free(array);
+    }
     return sorted ? EXIT_SUCCESS : EXIT_FAILURE;
 }
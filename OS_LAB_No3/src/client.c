@@ -1,4 +1,4 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 #include <errno.h>
 #include <fcntl.h>
 #include <stdbool.h>
@@ -6,11 +6,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
-#include <semaphore.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include "ring.h"
+
 #define BUFFER_SIZE 4096
-#define SHM_SIZE (BUFFER_SIZE + 8)
+#define FILE_BUFFER_SIZE 65536
 
 static size_t string_length(const char *text) {
 	size_t length = 0;
@@ -32,6 +34,76 @@ static void fail(const char *message) {
 	write_all(STDERR_FILENO, message, string_length(message));
 	_exit(EXIT_FAILURE);
 }
+// results are collected here and written to the file in large blocks
+typedef struct {
+	int fd;
+	size_t length;
+	char data[FILE_BUFFER_SIZE];
+} file_buffer_t;
+
+static void file_buffer_flush(file_buffer_t *buffer) {
+	write_all(buffer->fd, buffer->data, buffer->length);
+	buffer->length = 0;
+}
+
+static void file_buffer_append(file_buffer_t *buffer, const char *data, size_t length) {
+	if (buffer->length + length > sizeof(buffer->data)) file_buffer_flush(buffer);
+	memcpy(buffer->data + buffer->length, data, length);
+	buffer->length += length;
+}
+
+// responses to one request frame, filled in place in the response ring with the same layout
+typedef struct {
+	ring_t *ring;
+	uint64_t first;
+	uint32_t count;
+	bool open;
+} response_frame_t;
+
+static void frame_commit(response_frame_t *frame) {
+	if (!frame->open) return;
+	ring_write_open(frame->ring, sizeof(frame->first), &frame->count, sizeof(frame->count));
+	ring_commit(frame->ring);
+	frame->open = false;
+}
+// add a response; if the ring is full, the frame is published as is and a new one starts,
+// so the parent can drain the ring while this process waits for space
+static void frame_append(response_frame_t *frame, uint64_t sequence, const char *text, size_t length) {
+	uint32_t text_length = (uint32_t)length;
+	while (true) {
+		if (!frame->open) {
+			size_t header = sizeof(frame->first) + sizeof(frame->count);
+			while (!ring_has_space(frame->ring, ring_record_size(header + sizeof(text_length) + length))) {
+				ring_wait_space(frame->ring);
+			}
+			uint32_t count_placeholder = 0;
+			frame->first = sequence;
+			frame->count = 0;
+			frame->open = true;
+			ring_try_append_parts(frame->ring, &frame->first, sizeof(frame->first),
+			                      &count_placeholder, sizeof(count_placeholder));
+		}
+		if (ring_try_append_parts(frame->ring, &text_length, sizeof(text_length), text, length)) {
+			++frame->count;
+			return;
+		}
+		frame_commit(frame);
+	}
+}
+
+static void *open_ring_segment(const char *name, size_t *size) {
+	int fd = shm_open(name, O_RDWR, 0);
+	if (fd == -1) return NULL;
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return NULL;
+	}
+	*size = (size_t)st.st_size;
+	void *memory = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	return memory == MAP_FAILED ? NULL : memory;
+}
 
 
 static bool parse_and_sum(char *line, double *result) {
@@ -103,180 +175,158 @@ static size_t format_double(double value, char *buffer, size_t capacity) {
 }
 
 int main(int argc, char **argv) {
-	// Check arguments: filename, shm_p2c, shm_c2p, sem_pw, sem_cr, sem_cw, sem_pr
-	if (argc < 8) {
+	// Check arguments: filename, shm_p2c, shm_c2p
+	if (argc < 4) {
 		fail("error: insufficient arguments\n");
 	}
 
 	const char *filename = argv[1];
 	const char *shm_parent_to_child_name = argv[2];
 	const char *shm_child_to_parent_name = argv[3];
-	const char *sem_parent_write_name = argv[4];
-	const char *sem_child_read_name = argv[5];
-	const char *sem_child_write_name = argv[6];
-	const char *sem_parent_read_name = argv[7];
-
-	// Open shared memory segments
-	int shm_p2c_fd = shm_open(shm_parent_to_child_name, O_RDWR, 0);
-	if (shm_p2c_fd == -1) {
+
+	// Open shared memory rings created by the parent
+	size_t shm_p2c_size = 0;
+	void *shm_p2c = open_ring_segment(shm_parent_to_child_name, &shm_p2c_size);
+	if (shm_p2c == NULL) {
 		fail("error: failed to open parent-to-child shared memory\n");
 	}
-	void *shm_p2c = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_p2c_fd, 0);
-	if (shm_p2c == MAP_FAILED) {
-		close(shm_p2c_fd);
-		fail("error: failed to map parent-to-child shared memory\n");
-	}
-	close(shm_p2c_fd);
-
-	int shm_c2p_fd = shm_open(shm_child_to_parent_name, O_RDWR, 0);
-	if (shm_c2p_fd == -1) {
-		munmap(shm_p2c, SHM_SIZE);
+	size_t shm_c2p_size = 0;
+	void *shm_c2p = open_ring_segment(shm_child_to_parent_name, &shm_c2p_size);
+	if (shm_c2p == NULL) {
+		munmap(shm_p2c, shm_p2c_size);
 		fail("error: failed to open child-to-parent shared memory\n");
 	}
-	void *shm_c2p = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_c2p_fd, 0);
-	if (shm_c2p == MAP_FAILED) {
-		close(shm_c2p_fd);
-		munmap(shm_p2c, SHM_SIZE);
-		fail("error: failed to map child-to-parent shared memory\n");
-	}
-	close(shm_c2p_fd);
-
-	// Open semaphores
-	sem_t *sem_parent_write = sem_open(sem_parent_write_name, 0);
-	sem_t *sem_child_read = sem_open(sem_child_read_name, 0);
-	sem_t *sem_child_write = sem_open(sem_child_write_name, 0);
-	sem_t *sem_parent_read = sem_open(sem_parent_read_name, 0);
-
-	if (sem_parent_write == SEM_FAILED || sem_child_read == SEM_FAILED ||
-	    sem_child_write == SEM_FAILED || sem_parent_read == SEM_FAILED) {
-		munmap(shm_p2c, SHM_SIZE);
-		munmap(shm_c2p, SHM_SIZE);
-		if (sem_parent_write != SEM_FAILED) sem_close(sem_parent_write);
-		if (sem_child_read != SEM_FAILED) sem_close(sem_child_read);
-		if (sem_child_write != SEM_FAILED) sem_close(sem_child_write);
-		if (sem_parent_read != SEM_FAILED) sem_close(sem_parent_read);
-		fail("error: failed to open semaphores\n");
-	}
 
+	ring_t requests;
+	ring_t responses;
+	ring_attach(&requests, shm_p2c, 0, false);
+	ring_attach(&responses, shm_c2p, 0, true);
+
+	// "-" instead of a filename: one of several workers, the parent writes results in input order
+	bool write_file = strcmp(filename, "-") != 0;
 	// O_WRONLY - write only, O_CREAT - create if not exists, O_TRUNC - truncate if exists, 0600 - R & W
-	int file = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	int file = write_file ? open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600) : STDOUT_FILENO;
 	if (file == -1) {
-		munmap(shm_p2c, SHM_SIZE);
-		munmap(shm_c2p, SHM_SIZE);
-		sem_close(sem_parent_write);
-		sem_close(sem_child_read);
-		sem_close(sem_child_write);
-		sem_close(sem_parent_read);
+		munmap(shm_p2c, shm_p2c_size);
+		munmap(shm_c2p, shm_c2p_size);
 		fail("error: failed to open file\n");
 	}
 
-	char line[BUFFER_SIZE];
-	bool should_continue = true;
-
-	while(should_continue) {
-		// Wait for parent to write
-		if (sem_wait(sem_parent_write) == -1) {
-			fail("error: failed to wait sem_parent_write\n");
+	static file_buffer_t results;
+	results.fd = file;
+	// A request frame is the first sequence number, the line count and length-prefixed lines;
+	// the buffer grows to the longest frame
+	size_t request_capacity = BUFFER_SIZE;
+	char *request = (char *)malloc(request_capacity);
+	if (request == NULL) {
+		fail("error: failed to allocate request buffer\n");
+	}
+	response_frame_t frame = { .ring = &responses };
+
+	while(true) {
+		// Read frame from the request ring; write out results before sleeping on an empty one
+		int64_t length = ring_peek(&requests);
+		if (length < 0) {
+			file_buffer_flush(&results);
+			ring_wait_data(&requests);
+			continue;
 		}
-
-		// Read line from shared memory (parent to child)
-		size_t *size_ptr = (size_t *)shm_p2c;
-		size_t line_length = *size_ptr;
-		char *data_ptr = (char *)shm_p2c + sizeof(size_t);
-
-		if (line_length == 0) {
-			should_continue = false;
-			// Signal that child has read
-			if (sem_post(sem_child_read) == -1) {
-				fail("error: failed to post sem_child_read\n");
+		if ((size_t)length >= request_capacity) {
+			while ((size_t)length >= request_capacity) request_capacity *= 2;
+			free(request);
+			request = (char *)malloc(request_capacity);
+			if (request == NULL) {
+				fail("error: failed to allocate request buffer\n");
 			}
-			break;
-		}
-
-		// Copy line to local buffer
-		if (line_length >= BUFFER_SIZE) {
-			line_length = BUFFER_SIZE - 1;
 		}
-		memcpy(line, data_ptr, line_length);
-		line[line_length] = '\0';
+		ring_try_pop(&requests, request, request_capacity - 1);
 
-		// Signal that child has read
-		if (sem_post(sem_child_read) == -1) {
-			fail("error: failed to post sem_child_read\n");
+		if (length == 0) {
+			// Answer the termination signal after all responses
+			ring_push(&responses, "", 0);
+			break;
 		}
 
-		// Process the line
-		if (line_length > 0 && line[line_length - 1] == '\n') {
-			line[line_length - 1] = '\0';
+		uint64_t sequence;
+		uint32_t count;
+		size_t offset = sizeof(sequence) + sizeof(count);
+		if ((size_t)length < offset) {
+			fail("error: malformed request\n");
 		}
+		memcpy(&sequence, request, sizeof(sequence));
+		memcpy(&count, request + sizeof(sequence), sizeof(count));
 
-		double sum = 0.0;
-		bool valid = parse_and_sum(line, &sum);
-		
-		char response[BUFFER_SIZE];
-		size_t response_length = 0;
-
-		if (!valid) {
-			const char warning[] = "error: invalid input\n";
-			response_length = sizeof(warning) - 1;
-			memcpy(response, warning, response_length);
-		} else {
-			char value_buffer[128];
-			size_t value_length = format_double(sum, value_buffer, sizeof(value_buffer));
-			if (value_length == 0) {
-				fail("error: failed to format result\n");
+		for (uint32_t i = 0; i < count; ++i, ++sequence) {
+			uint32_t line_length;
+			if (offset + sizeof(line_length) > (size_t)length) {
+				fail("error: malformed request\n");
 			}
-
-			const char prefix[] = "sum: ";
-			const char newline = '\n';
-			
-			// Write to file
-			write_all(file, prefix, sizeof(prefix) - 1);
-			write_all(file, value_buffer, value_length);
-			write_all(file, &newline, 1);
-
-			// Prepare response for parent
-			size_t index = 0;
-			memcpy(response + index, prefix, sizeof(prefix) - 1);
-			index += sizeof(prefix) - 1;
-			memcpy(response + index, value_buffer, value_length);
-			index += value_length;
-			response[index++] = newline;
-			response_length = index;
-		}
-
-		// Write response to shared memory (child to parent)
-		size_t *resp_size_ptr = (size_t *)shm_c2p;
-		*resp_size_ptr = response_length;
-		char *resp_data_ptr = (char *)shm_c2p + sizeof(size_t);
-		if (response_length > 0) {
-			memcpy(resp_data_ptr, response, response_length);
-			if (response_length < SHM_SIZE - sizeof(size_t)) {
-				resp_data_ptr[response_length] = '\0';
+			memcpy(&line_length, request + offset, sizeof(line_length));
+			offset += sizeof(line_length);
+			if (offset + line_length > (size_t)length) {
+				fail("error: malformed request\n");
+			}
+			char *line = request + offset;
+			offset += line_length;
+			// The byte after the line is the next length prefix or spare space: terminate
+			// the line in place and restore the byte after parsing
+			char saved = line[line_length];
+			line[line_length] = '\0';
+
+			// Process the line
+			if (line_length > 0 && line[line_length - 1] == '\n') {
+				line[line_length - 1] = '\0';
 			}
-		}
 
-		// Signal that child has written
-		if (sem_post(sem_child_write) == -1) {
-			fail("error: failed to post sem_child_write\n");
-		}
+			double sum = 0.0;
+			bool valid = parse_and_sum(line, &sum);
+			line[line_length] = saved;
+
+			char response[BUFFER_SIZE];
+			size_t response_length = 0;
+
+			if (!valid) {
+				const char warning[] = "error: invalid input\n";
+				response_length = sizeof(warning) - 1;
+				memcpy(response, warning, response_length);
+			} else {
+				char value_buffer[128];
+				size_t value_length = format_double(sum, value_buffer, sizeof(value_buffer));
+				if (value_length == 0) {
+					fail("error: failed to format result\n");
+				}
+
+				const char prefix[] = "sum: ";
+				const char newline = '\n';
+
+				// Prepare response for parent
+				size_t index = 0;
+				memcpy(response + index, prefix, sizeof(prefix) - 1);
+				index += sizeof(prefix) - 1;
+				memcpy(response + index, value_buffer, value_length);
+				index += value_length;
+				response[index++] = newline;
+				response_length = index;
+
+				// Write to file
+				if (write_file) file_buffer_append(&results, response, response_length);
+			}
 
-		// Wait for parent to read
-		if (sem_wait(sem_parent_read) == -1) {
-			fail("error: failed to wait sem_parent_read\n");
+			// Add response to the response frame (child to parent)
+			frame_append(&frame, sequence, response, response_length);
 		}
+		// One publication for the responses to the whole request frame
+		frame_commit(&frame);
 	}
 
-	if (close(file) == -1) {
+	free(request);
+	file_buffer_flush(&results);
+	if (write_file && close(file) == -1) {
 		fail("error: failed to close file\n");
 	}
 
-	munmap(shm_p2c, SHM_SIZE);
-	munmap(shm_c2p, SHM_SIZE);
-	sem_close(sem_parent_write);
-	sem_close(sem_child_read);
-	sem_close(sem_child_write);
-	sem_close(sem_parent_read);
+	munmap(shm_p2c, shm_p2c_size);
+	munmap(shm_c2p, shm_c2p_size);
 
 	return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,190 @@
+#ifndef RING_H
+#define RING_H
+
+// Single-producer/single-consumer ring of length-prefixed records in shared memory.
+// Both cursors count bytes since the start and only grow; each lives on its own cache line
+// with the idle flag its owner sleeps on, so the two processes never write the same line.
+#include <linux/futex.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define RING_CACHE_LINE 64
+#define RING_CAPACITY ((size_t)1 << 20)
+#define RING_RECORD_ALIGN 8
+// polls of the other side's cursor before going to sleep on the futex
+#define RING_SPIN 256
+
+typedef struct {
+	// written by the producer
+	alignas(RING_CACHE_LINE) _Atomic uint64_t head;
+	_Atomic uint32_t producer_idle;
+	// written by the consumer
+	alignas(RING_CACHE_LINE) _Atomic uint64_t tail;
+	_Atomic uint32_t consumer_idle;
+	// set once by the creator before the other process attaches
+	alignas(RING_CACHE_LINE) uint64_t capacity;
+	alignas(RING_CACHE_LINE) char data[];
+} ring_shared_t;
+
+// process-local view: the cursor this side owns and the last seen value of the other one;
+// the producer also keeps the length of a record it is filling in place and has not published
+typedef struct {
+	ring_shared_t *shared;
+	uint64_t mask;
+	uint64_t cursor;
+	uint64_t other;
+	size_t open;
+} ring_t;
+
+static inline size_t ring_map_size(size_t capacity) {
+	return sizeof(ring_shared_t) + capacity;
+}
+
+static inline size_t ring_record_size(size_t length) {
+	return (sizeof(uint64_t) + length + RING_RECORD_ALIGN - 1) & ~(size_t)(RING_RECORD_ALIGN - 1);
+}
+// capacity must be a power of two; the creator passes it, the other side reads it from the segment
+static inline void ring_attach(ring_t *ring, void *memory, size_t capacity, bool producer) {
+	ring->shared = (ring_shared_t *)memory;
+	ring->open = 0;
+	if (capacity != 0) ring->shared->capacity = capacity;
+	ring->mask = ring->shared->capacity - 1;
+	ring->cursor = atomic_load_explicit(producer ? &ring->shared->head : &ring->shared->tail, memory_order_relaxed);
+	ring->other = atomic_load_explicit(producer ? &ring->shared->tail : &ring->shared->head, memory_order_acquire);
+}
+
+static inline void ring_futex_wait(_Atomic uint32_t *word) {
+	syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, 1, NULL, NULL, 0);
+}
+
+static inline void ring_futex_wake(_Atomic uint32_t *word) {
+	syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+// sleep until *cursor moves away from seen; the flag is raised before the last check, and the
+// other side checks the flag after moving the cursor, so at least one of them sees the other
+static inline void ring_wait(_Atomic uint64_t *cursor, uint64_t seen, _Atomic uint32_t *idle) {
+	for (int spin = 0; spin < RING_SPIN; ++spin) {
+		if (atomic_load_explicit(cursor, memory_order_acquire) != seen) return;
+	}
+	while (true) {
+		atomic_store(idle, 1);
+		if (atomic_load(cursor) != seen) break;
+		ring_futex_wait(idle);
+	}
+	atomic_store_explicit(idle, 0, memory_order_relaxed);
+}
+// publish a moved cursor and wake the other side only if it went to sleep
+static inline void ring_publish(_Atomic uint64_t *cursor, uint64_t value, _Atomic uint32_t *idle) {
+	atomic_store(cursor, value);
+	if (atomic_load(idle) != 0 && atomic_exchange(idle, 0) != 0) ring_futex_wake(idle);
+}
+
+static inline void ring_copy_in(ring_t *ring, uint64_t position, const void *source, size_t length) {
+	size_t offset = (size_t)(position & ring->mask);
+	size_t first = ring->mask + 1 - offset;
+	if (first > length) first = length;
+	memcpy(ring->shared->data + offset, source, first);
+	memcpy(ring->shared->data, (const char *)source + first, length - first);
+}
+
+static inline void ring_copy_out(const ring_t *ring, uint64_t position, void *target, size_t length) {
+	size_t offset = (size_t)(position & ring->mask);
+	size_t first = ring->mask + 1 - offset;
+	if (first > length) first = length;
+	memcpy(target, ring->shared->data + offset, first);
+	memcpy((char *)target + first, ring->shared->data, length - first);
+}
+// producer: free bytes without touching the consumer's cache line unless the cached tail is not enough
+static inline bool ring_has_space(ring_t *ring, size_t bytes) {
+	uint64_t capacity = ring->mask + 1;
+	if (ring->cursor + bytes - ring->other <= capacity) return true;
+	ring->other = atomic_load_explicit(&ring->shared->tail, memory_order_acquire);
+	return ring->cursor + bytes - ring->other <= capacity;
+}
+// producer: add bytes to the record being filled in place; the consumer sees nothing
+// until ring_commit, so one publication (and at most one wake) covers the whole record
+static inline bool ring_try_append_parts(ring_t *ring, const void *first, size_t first_length,
+                                         const void *second, size_t second_length) {
+	size_t length = ring->open + first_length + second_length;
+	if (!ring_has_space(ring, ring_record_size(length))) return false;
+	uint64_t position = ring->cursor + sizeof(uint64_t) + ring->open;
+	ring_copy_in(ring, position, first, first_length);
+	ring_copy_in(ring, position + first_length, second, second_length);
+	ring->open = length;
+	return true;
+}
+// producer: overwrite bytes already appended to the open record (e.g. a count known at the end)
+static inline void ring_write_open(ring_t *ring, size_t offset, const void *data, size_t length) {
+	ring_copy_in(ring, ring->cursor + sizeof(uint64_t) + offset, data, length);
+}
+
+static inline void ring_commit(ring_t *ring) {
+	uint64_t header = ring->open;
+	ring_copy_in(ring, ring->cursor, &header, sizeof(header));
+	ring->cursor += ring_record_size(ring->open);
+	ring->open = 0;
+	ring_publish(&ring->shared->head, ring->cursor, &ring->shared->consumer_idle);
+}
+// producer: append a whole record made of two parts (e.g. a sequence number and a line);
+// false if it does not fit right now
+static inline bool ring_try_push_parts(ring_t *ring, const void *first, size_t first_length,
+                                       const void *second, size_t second_length) {
+	if (!ring_try_append_parts(ring, first, first_length, second, second_length)) return false;
+	ring_commit(ring);
+	return true;
+}
+
+static inline bool ring_try_push(ring_t *ring, const void *data, size_t length) {
+	return ring_try_push_parts(ring, data, length, "", 0);
+}
+// producer: sleep until the consumer frees space
+static inline void ring_wait_space(ring_t *ring) {
+	ring_wait(&ring->shared->tail, ring->other, &ring->shared->producer_idle);
+	ring->other = atomic_load_explicit(&ring->shared->tail, memory_order_acquire);
+}
+
+static inline void ring_push(ring_t *ring, const void *data, size_t length) {
+	while (!ring_try_push(ring, data, length)) ring_wait_space(ring);
+}
+
+static inline void ring_push_parts(ring_t *ring, const void *first, size_t first_length,
+                                   const void *second, size_t second_length) {
+	while (!ring_try_push_parts(ring, first, first_length, second, second_length)) ring_wait_space(ring);
+}
+// consumer: length of the next record or -1 if the ring is empty
+static inline int64_t ring_peek(ring_t *ring) {
+	if (ring->cursor == ring->other) {
+		ring->other = atomic_load_explicit(&ring->shared->head, memory_order_acquire);
+		if (ring->cursor == ring->other) return -1;
+	}
+	uint64_t header;
+	ring_copy_out(ring, ring->cursor, &header, sizeof(header));
+	return (int64_t)header;
+}
+// consumer: copy the next record (truncated to capacity) and release its space; -1 if empty
+static inline int64_t ring_try_pop(ring_t *ring, void *target, size_t capacity) {
+	int64_t length = ring_peek(ring);
+	if (length < 0) return -1;
+	size_t copied = (size_t)length < capacity ? (size_t)length : capacity;
+	ring_copy_out(ring, ring->cursor + sizeof(uint64_t), target, copied);
+	ring->cursor += ring_record_size((size_t)length);
+	ring_publish(&ring->shared->tail, ring->cursor, &ring->shared->producer_idle);
+	return length;
+}
+// consumer: sleep until the producer appends a record
+static inline void ring_wait_data(ring_t *ring) {
+	ring_wait(&ring->shared->head, ring->other, &ring->shared->consumer_idle);
+}
+
+static inline int64_t ring_pop(ring_t *ring, void *target, size_t capacity) {
+	int64_t length;
+	while ((length = ring_try_pop(ring, target, capacity)) < 0) ring_wait_data(ring);
+	return length;
+}
+
+#endif
@@ -1,20 +1,26 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
-#include <semaphore.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "ring.h"
+
 #define CHILD_PROGRAM_NAME "lab_01_child"
 #define MAX_LINE_LENGTH 4096
-#define SHM_SIZE (MAX_LINE_LENGTH + 8)
+#define INPUT_BLOCK_SIZE ((size_t)1 << 16)
+#define OUTPUT_BUFFER_SIZE 65536
 
 static size_t string_length(const char *text) {
 	size_t length = 0;
@@ -35,24 +41,93 @@ static void fail(const char *message) {
 	write_all(STDERR_FILENO, message, string_length(message));
 	_exit(EXIT_FAILURE);
 }
-//
-static ssize_t read_line(int fd, char *buffer, size_t capacity) {
-	if (capacity == 0) return -1;
-
-	size_t offset = 0;
-	while (offset + 1 < capacity) {
-		char ch;
-		ssize_t bytes = read(fd, &ch, 1);
-		if (bytes < 0) {
-			return -1;
+// Input is read in large blocks, or mapped whole when stdin is a regular file, and handed out
+// as views into the block: a line stays valid until the next input_next_line call
+typedef struct {
+	int fd;
+	char *data;
+	size_t capacity;
+	size_t start;
+	size_t end;
+	bool mapped;
+	bool eof;
+} input_t;
+
+static void input_open(input_t *input, int fd) {
+	*input = (input_t){ .fd = fd };
+	struct stat st;
+	off_t offset = lseek(fd, 0, SEEK_CUR);
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && offset >= 0 && st.st_size > offset) {
+		void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+			input->data = (char *)data;
+			input->capacity = (size_t)st.st_size;
+			input->start = (size_t)offset;
+			input->end = (size_t)st.st_size;
+			input->mapped = true;
+			input->eof = true;
+			return;
 		}
-		if (bytes == 0) break;
-
-		buffer[offset++] = ch;
-		if (ch == '\n') break;
 	}
-	buffer[offset] = '\0';
-	return (ssize_t)offset;
+	input->capacity = INPUT_BLOCK_SIZE;
+	input->data = (char *)malloc(input->capacity);
+	if (input->data == NULL) fail("error: failed to allocate input buffer\n");
+}
+// leave a mapped file positioned after the consumed lines, as byte-wise reading did
+static void input_close(input_t *input) {
+	if (input->mapped) {
+		lseek(input->fd, (off_t)input->start, SEEK_SET);
+		munmap(input->data, input->capacity);
+	} else {
+		free(input->data);
+	}
+}
+// read the next block behind the buffered bytes; the buffer doubles when one line fills it
+static void input_fill(input_t *input) {
+	if (input->start > 0) {
+		memmove(input->data, input->data + input->start, input->end - input->start);
+		input->end -= input->start;
+		input->start = 0;
+	}
+	if (input->end == input->capacity) {
+		char *grown = (char *)realloc(input->data, input->capacity * 2);
+		if (grown == NULL) fail("error: failed to grow input buffer\n");
+		input->data = grown;
+		input->capacity *= 2;
+	}
+	ssize_t bytes;
+	do {
+		bytes = read(input->fd, input->data + input->end, input->capacity - input->end);
+	} while (bytes < 0 && errno == EINTR);
+	if (bytes < 0) fail("error: failed to read input line\n");
+	if (bytes == 0) input->eof = true;
+	input->end += (size_t)bytes;
+}
+// next line with its \n (the last one may lack it); length 0 at end of input.
+// Reading stops after limit bytes without \n: a length above limit only marks the line as too long
+static size_t input_next_line(input_t *input, const char **line, size_t limit) {
+	size_t scanned = 0;
+	while (true) {
+		char *begin = input->data + input->start;
+		size_t available = input->end - input->start;
+		char *newline = (char *)memchr(begin + scanned, '\n', available - scanned);
+		if (newline != NULL || input->eof || available > limit) {
+			size_t length = newline != NULL ? (size_t)(newline - begin) + 1 : available;
+			if (length > limit) length = limit + 1;
+			*line = begin;
+			input->start += length;
+			return length;
+		}
+		scanned = available;
+		input_fill(input);
+	}
+}
+// true if the next line can be taken without blocking
+static bool input_ready(input_t *input) {
+	if (input->eof || memchr(input->data + input->start, '\n', input->end - input->start) != NULL) return true;
+	struct pollfd request = { .fd = input->fd, .events = POLLIN };
+	return poll(&request, 1, 0) > 0;
 }
 // input
 static void trim_trailing_newline(char *line) {
@@ -105,237 +180,524 @@ static void generate_unique_name(char *buffer, size_t capacity, const char *pref
 		fail("error: failed to generate unique name\n");
 	}
 }
-// write line to output_fd if line does not end with \n
-static void forward_line(int output_fd, const char *line) {
-	size_t length = string_length(line);
-	if (length == 0 || line[length - 1] != '\n') {
-		write_all(output_fd, line, length);
-		write_all(output_fd, "\n", 1);
+typedef struct {
+	int fd;
+	size_t length;
+	char data[OUTPUT_BUFFER_SIZE];
+} output_t;
+
+static void output_flush(output_t *output) {
+	write_all(output->fd, output->data, output->length);
+	output->length = 0;
+}
+
+static void output_append(output_t *output, const char *data, size_t length) {
+	if (output->length + length > sizeof(output->data)) output_flush(output);
+	if (length > sizeof(output->data)) {
+		write_all(output->fd, data, length);
 		return;
 	}
-	write_all(output_fd, line, length);
+	memcpy(output->data + output->length, data, length);
+	output->length += length;
+}
+// append line to output, adding \n if line does not end with it
+static void forward_line(output_t *output, const char *line, size_t length) {
+	output_append(output, line, length);
+	if (length == 0 || line[length - 1] != '\n') output_append(output, "\n", 1);
+}
+static void *create_ring_segment(const char *name, size_t size) {
+	int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+	if (fd == -1) return NULL;
+	if (ftruncate(fd, (off_t)size) == -1) {
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+	void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (memory == MAP_FAILED) {
+		shm_unlink(name);
+		return NULL;
+	}
+	return memory;
+}
+#define MAX_WORKERS 64
+#define DISPATCH_CAPACITY ((size_t)1 << 20)
+// responses with this prefix are the results the child would write to the file
+#define RESULT_PREFIX "sum: "
+// a frame is closed when its lines reach this part of the ring
+#define FRAME_SHARE 8
+
+typedef enum {
+	DISPATCH_ROUND_ROBIN,
+	// the worker with the fewest unread request bytes
+	DISPATCH_DEPTH
+} dispatch_t;
+// child process with its own pair of rings
+typedef struct {
+	char shm_p2c_name[256];
+	char shm_c2p_name[256];
+	void *shm_p2c;
+	void *shm_c2p;
+	ring_t requests;
+	ring_t responses;
+	pid_t pid;
+} worker_t;
+// consecutive lines sent to one worker as one frame
+typedef struct {
+	uint32_t worker;
+	uint32_t count;
+} dispatch_entry_t;
+// parent side of the channels. Lines go to workers in frames: the sequence number of the first
+// line, the line count and length-prefixed lines, filled in place in the ring and published at
+// once. Responses come back in frames of the same layout. Each sent frame is recorded in the
+// dispatch ring, so the output side knows whose responses come next and restores input order
+typedef struct {
+	worker_t *workers;
+	int worker_count;
+	dispatch_t dispatch;
+	int next_worker;
+	size_t frame_limit;
+	// longest line a frame of its own can carry through the ring; a longer one ends the session
+	size_t max_line;
+	bool line_too_long;
+	// frame being filled: its worker (-1 if none), first sequence number and line count
+	int frame_worker;
+	uint64_t frame_first;
+	uint32_t frame_count;
+	// worker that refused the last frame
+	int blocked_worker;
+	// two views of one in-process ring: the input side writes it, the output side reads it
+	ring_t dispatch_writer;
+	ring_t dispatch_reader;
+	// worker of the next responses (-1 if not taken from the dispatch ring yet) and their number
+	int pending;
+	uint32_t pending_lines;
+	char *response_frame;
+	size_t response_capacity;
+	uint64_t sent;
+	uint64_t received;
+	output_t output;
+	// with several workers the parent writes results to the file itself, in input order
+	output_t *results;
+} session_t;
+
+static size_t pending_bytes(ring_t *ring) {
+	ring->other = atomic_load_explicit(&ring->shared->tail, memory_order_acquire);
+	return (size_t)(ring->cursor - ring->other);
 }
 
-int main(void) {
-	char filename[MAX_LINE_LENGTH];
-	ssize_t filename_len = read_line(STDIN_FILENO, filename, sizeof(filename));
-	if (filename_len <= 0) {
-		fail("error: failed to read filename\n");
+static int choose_worker(session_t *session) {
+	int count = session->worker_count;
+	int first = session->next_worker;
+	if (session->dispatch == DISPATCH_ROUND_ROBIN) return first;
+
+	int best = first;
+	size_t best_bytes = pending_bytes(&session->workers[first].requests);
+	for (int i = 1; i < count && best_bytes > 0; ++i) {
+		int index = (first + i) % count;
+		size_t bytes = pending_bytes(&session->workers[index].requests);
+		if (bytes < best_bytes) {
+			best = index;
+			best_bytes = bytes;
+		}
 	}
+	return best;
+}
+// publish the open frame and record it for the output side
+static void commit_frame(session_t *session) {
+	if (session->frame_worker < 0) return;
+	ring_t *requests = &session->workers[session->frame_worker].requests;
+	ring_write_open(requests, sizeof(session->frame_first), &session->frame_count, sizeof(session->frame_count));
+	ring_commit(requests);
+	// space in the dispatch ring was checked when the frame was opened
+	dispatch_entry_t entry = { (uint32_t)session->frame_worker, session->frame_count };
+	ring_push(&session->dispatch_writer, &entry, sizeof(entry));
+	session->frame_worker = -1;
+}
 
-	trim_trailing_newline(filename);
-	if (string_length(filename) == 0) {
-		fail("error: filename must not be empty\n");
+static bool try_send_request(session_t *session, const char *line, size_t length) {
+	uint32_t line_length = (uint32_t)length;
+	if (session->frame_worker >= 0) {
+		ring_t *requests = &session->workers[session->frame_worker].requests;
+		if (requests->open + sizeof(line_length) + length <= session->frame_limit &&
+		    ring_try_append_parts(requests, &line_length, sizeof(line_length), line, length)) {
+			++session->frame_count;
+			++session->sent;
+			return true;
+		}
+		commit_frame(session);
 	}
 
-	// Generate unique names for shared memory and semaphores
-	char shm_parent_to_child_name[256];
-	char shm_child_to_parent_name[256];
-	char sem_parent_write_name[256];
-	char sem_child_read_name[256];
-	char sem_child_write_name[256];
-	char sem_parent_read_name[256];
-
-	generate_unique_name(shm_parent_to_child_name, sizeof(shm_parent_to_child_name), "/shm_p2c");
-	generate_unique_name(shm_child_to_parent_name, sizeof(shm_child_to_parent_name), "/shm_c2p");
-	generate_unique_name(sem_parent_write_name, sizeof(sem_parent_write_name), "/sem_pw");
-	generate_unique_name(sem_child_read_name, sizeof(sem_child_read_name), "/sem_cr");
-	generate_unique_name(sem_child_write_name, sizeof(sem_child_write_name), "/sem_cw");
-	generate_unique_name(sem_parent_read_name, sizeof(sem_parent_read_name), "/sem_pr");
-
-	// Create shared memory for parent to child communication
-	int shm_p2c_fd = shm_open(shm_parent_to_child_name, O_CREAT | O_RDWR, 0600);
-	if (shm_p2c_fd == -1) {
-		fail("error: failed to create parent-to-child shared memory\n");
-	}
-	if (ftruncate(shm_p2c_fd, SHM_SIZE) == -1) {
-		shm_unlink(shm_parent_to_child_name);
-		fail("error: failed to truncate parent-to-child shared memory\n");
-	}
-	void *shm_p2c = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_p2c_fd, 0);
-	if (shm_p2c == MAP_FAILED) {
-		close(shm_p2c_fd);
-		shm_unlink(shm_parent_to_child_name);
-		fail("error: failed to map parent-to-child shared memory\n");
-	}
-	close(shm_p2c_fd);
-
-	// Create shared memory for child to parent communication
-	int shm_c2p_fd = shm_open(shm_child_to_parent_name, O_CREAT | O_RDWR, 0600);
-	if (shm_c2p_fd == -1) {
-		munmap(shm_p2c, SHM_SIZE);
-		shm_unlink(shm_parent_to_child_name);
-		fail("error: failed to create child-to-parent shared memory\n");
-	}
-	if (ftruncate(shm_c2p_fd, SHM_SIZE) == -1) {
-		munmap(shm_p2c, SHM_SIZE);
-		close(shm_c2p_fd);
-		shm_unlink(shm_parent_to_child_name);
-		shm_unlink(shm_child_to_parent_name);
-		fail("error: failed to truncate child-to-parent shared memory\n");
-	}
-	void *shm_c2p = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_c2p_fd, 0);
-	if (shm_c2p == MAP_FAILED) {
-		munmap(shm_p2c, SHM_SIZE);
-		close(shm_c2p_fd);
-		shm_unlink(shm_parent_to_child_name);
-		shm_unlink(shm_child_to_parent_name);
-		fail("error: failed to map child-to-parent shared memory\n");
-	}
-	close(shm_c2p_fd);
-
-	// Create semaphores
-	sem_t *sem_parent_write = sem_open(sem_parent_write_name, O_CREAT, 0600, 0);
-	sem_t *sem_child_read = sem_open(sem_child_read_name, O_CREAT, 0600, 0);
-	sem_t *sem_child_write = sem_open(sem_child_write_name, O_CREAT, 0600, 0);
-	sem_t *sem_parent_read = sem_open(sem_parent_read_name, O_CREAT, 0600, 0);
-
-	if (sem_parent_write == SEM_FAILED || sem_child_read == SEM_FAILED ||
-	    sem_child_write == SEM_FAILED || sem_parent_read == SEM_FAILED) {
-		munmap(shm_p2c, SHM_SIZE);
-		munmap(shm_c2p, SHM_SIZE);
-		shm_unlink(shm_parent_to_child_name);
-		shm_unlink(shm_child_to_parent_name);
-		if (sem_parent_write != SEM_FAILED) sem_close(sem_parent_write);
-		if (sem_child_read != SEM_FAILED) sem_close(sem_child_read);
-		if (sem_child_write != SEM_FAILED) sem_close(sem_child_write);
-		if (sem_parent_read != SEM_FAILED) sem_close(sem_parent_read);
-		sem_unlink(sem_parent_write_name);
-		sem_unlink(sem_child_read_name);
-		sem_unlink(sem_child_write_name);
-		sem_unlink(sem_parent_read_name);
-		fail("error: failed to create semaphores\n");
-	}
-
-	// Fork child process
-	pid_t child = fork();
-	if (child == -1) {
-		munmap(shm_p2c, SHM_SIZE);
-		munmap(shm_c2p, SHM_SIZE);
-		shm_unlink(shm_parent_to_child_name);
-		shm_unlink(shm_child_to_parent_name);
-		sem_close(sem_parent_write);
-		sem_close(sem_child_read);
-		sem_close(sem_child_write);
-		sem_close(sem_parent_read);
-		sem_unlink(sem_parent_write_name);
-		sem_unlink(sem_child_read_name);
-		sem_unlink(sem_child_write_name);
-		sem_unlink(sem_parent_read_name);
-		fail("error: failed to fork\n");
-	}
-
-	if (child == 0) {
-		// Close semaphores in child (will reopen them)
-		sem_close(sem_parent_write);
-		sem_close(sem_child_read);
-		sem_close(sem_child_write);
-		sem_close(sem_parent_read);
-		munmap(shm_p2c, SHM_SIZE);
-		munmap(shm_c2p, SHM_SIZE);
-
-		char child_path[PATH_MAX];
-		build_child_path(child_path, sizeof(child_path));
-		// Pass filename and shared memory/semaphore names to child process
-		char *const args[] = {
-			CHILD_PROGRAM_NAME,
-			filename,
-			shm_parent_to_child_name,
-			shm_child_to_parent_name,
-			sem_parent_write_name,
-			sem_child_read_name,
-			sem_child_write_name,
-			sem_parent_read_name,
-			NULL
-		};
-		execv(child_path, args);
-		fail("error: exec failed\n");
-	}
-
-	// Parent process: communicate via shared memory
-	char line_buffer[MAX_LINE_LENGTH];
-	while(true) {
-		ssize_t line_length = read_line(STDIN_FILENO, line_buffer, sizeof(line_buffer));
-		if (line_length == -1) {
-			fail("error: failed to read input line\n");
+	// Open a new frame: header and the first line must fit, and the dispatch entry later
+	if (!ring_has_space(&session->dispatch_writer, ring_record_size(sizeof(dispatch_entry_t)))) {
+		session->blocked_worker = -1;
+		return false;
+	}
+	int worker = choose_worker(session);
+	ring_t *requests = &session->workers[worker].requests;
+	size_t header = sizeof(session->frame_first) + sizeof(session->frame_count);
+	if (!ring_has_space(requests, ring_record_size(header + sizeof(line_length) + length))) {
+		session->blocked_worker = worker;
+		return false;
+	}
+	session->frame_worker = worker;
+	session->frame_first = session->sent;
+	session->frame_count = 1;
+	session->next_worker = (worker + 1) % session->worker_count;
+	uint32_t count_placeholder = 0;
+	ring_try_append_parts(requests, &session->frame_first, sizeof(session->frame_first),
+	                      &count_placeholder, sizeof(count_placeholder));
+	ring_try_append_parts(requests, &line_length, sizeof(line_length), line, length);
+	++session->sent;
+	return true;
+}
+// termination: the open frame is published, then an empty record goes to every worker
+// and to the dispatch ring; *terminated counts workers that already got it
+static bool try_send_termination(session_t *session, int *terminated) {
+	commit_frame(session);
+	while (*terminated < session->worker_count) {
+		if (!ring_try_push(&session->workers[*terminated].requests, "", 0)) {
+			session->blocked_worker = *terminated;
+			return false;
 		}
+		++*terminated;
+	}
+	if (!ring_try_push(&session->dispatch_writer, "", 0)) {
+		session->blocked_worker = -1;
+		return false;
+	}
+	return true;
+}
 
-		if (line_length == 0 || line_buffer[0] == '\n') {
-			// Send termination signal to child
-			size_t *size_ptr = (size_t *)shm_p2c;
-			*size_ptr = 0;
-			
-			// Signal that parent has written (termination signal)
-			if (sem_post(sem_parent_write) == -1) {
-				fail("error: failed to post sem_parent_write\n");
+static void flush_outputs(session_t *session) {
+	output_flush(&session->output);
+	if (session->results) output_flush(session->results);
+}
+// forward the next response frame in input order: 1 if forwarded, 0 if none is ready (only
+// without wait), -1 once all workers answered termination; output is flushed before sleeping
+static int receive_response(session_t *session, bool wait) {
+	if (session->pending < 0) {
+		dispatch_entry_t entry;
+		int64_t length;
+		while ((length = ring_try_pop(&session->dispatch_reader, &entry, sizeof(entry))) < 0) {
+			if (!wait) return 0;
+			flush_outputs(session);
+			ring_wait_data(&session->dispatch_reader);
+		}
+		if (length == 0) {
+			// Every worker answers the termination record last, after all its responses
+			flush_outputs(session);
+			for (int i = 0; i < session->worker_count; ++i) {
+				char terminator;
+				if (ring_pop(&session->workers[i].responses, &terminator, 0) != 0) {
+					fail("error: response after termination\n");
+				}
 			}
-			
-			// Wait for child to read termination signal
-			if (sem_wait(sem_child_read) == -1) {
-				fail("error: failed to wait sem_child_read\n");
+			return -1;
+		}
+		session->pending = (int)entry.worker;
+		session->pending_lines = entry.count;
+	}
+
+	// A worker may split the responses to one request frame into several frames
+	ring_t *responses = &session->workers[session->pending].responses;
+	char *frame = session->response_frame;
+	int64_t length;
+	while ((length = ring_try_pop(responses, frame, session->response_capacity)) < 0) {
+		if (!wait) return 0;
+		flush_outputs(session);
+		ring_wait_data(responses);
+	}
+
+	uint64_t first;
+	uint32_t count;
+	size_t offset = sizeof(first) + sizeof(count);
+	if ((size_t)length < offset) fail("error: malformed response\n");
+	memcpy(&first, frame, sizeof(first));
+	memcpy(&count, frame + sizeof(first), sizeof(count));
+	if (first != session->received || count > session->pending_lines) fail("error: response out of order\n");
+
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t text_length;
+		if (offset + sizeof(text_length) > (size_t)length) fail("error: malformed response\n");
+		memcpy(&text_length, frame + offset, sizeof(text_length));
+		offset += sizeof(text_length);
+		if (offset + text_length > (size_t)length) fail("error: malformed response\n");
+		const char *text = frame + offset;
+		offset += text_length;
+		if (text_length > 0 && text_length < MAX_LINE_LENGTH) {
+			forward_line(&session->output, text, text_length);
+			size_t prefix_length = sizeof(RESULT_PREFIX) - 1;
+			if (session->results && text_length >= prefix_length && memcmp(text, RESULT_PREFIX, prefix_length) == 0) {
+				output_append(session->results, text, text_length);
 			}
+		}
+	}
+	session->received += count;
+	session->pending_lines -= count;
+	if (session->pending_lines == 0) session->pending = -1;
+	return 1;
+}
+// next line to send; empty at the end of input or on the terminating empty line. A line that
+// does not fit into the ring is rejected and ends the session like the end of input
+static size_t next_request(session_t *session, input_t *input, const char **line) {
+	size_t length = input_next_line(input, line, session->max_line);
+	if (length > session->max_line) {
+		const char message[] = "error: line does not fit into the ring, use a larger --segment\n";
+		write_all(STDERR_FILENO, message, sizeof(message) - 1);
+		session->line_too_long = true;
+		return 0;
+	}
+	return length > 0 && (*line)[0] == '\n' ? 0 : length;
+}
+// single thread: read lines and forward whatever responses are ready in between
+static void run_interleaved(session_t *session, input_t *input) {
+	while(true) {
+		// Before blocking on input, publish the open frame and deliver outstanding responses,
+		// so interactive use still answers every line; batch input is always ready and
+		// keeps the frames full
+		if (!input_ready(input)) {
+			commit_frame(session);
+			while (session->received < session->sent) receive_response(session, true);
+			flush_outputs(session);
+		}
+
+		const char *line;
+		size_t line_length = next_request(session, input, &line);
+		// Empty line or end of input: send termination signal to workers
+		bool last = line_length == 0;
+		int terminated = 0;
+
+		// A full ring means a worker is behind: take the next response in order, which always
+		// arrives since everything dispatched is published, instead of sleeping on this worker
+		// while it waits on its full response ring
+		while (!(last ? try_send_termination(session, &terminated)
+		              : try_send_request(session, line, line_length))) {
+			receive_response(session, true);
+		}
+		if (last) break;
+		while (receive_response(session, false) > 0) {}
+	}
+
+	while (receive_response(session, true) > 0) {}
+	flush_outputs(session);
+}
+// output stage of the pipelined mode: runs in its own thread and owns the response rings
+static void *output_stage(void *arg) {
+	session_t *session = (session_t *)arg;
+	while (receive_response(session, true) > 0) {}
+	flush_outputs(session);
+	return NULL;
+}
+// input side: sleep until the ring that refused the last frame frees space
+static void wait_for_space(session_t *session) {
+	if (session->blocked_worker < 0) {
+		ring_wait_space(&session->dispatch_writer);
+	} else {
+		ring_wait_space(&session->workers[session->blocked_worker].requests);
+	}
+}
+// two stages: the calling thread reads stdin and fills the request rings while the output
+// stage drains responses, so reading, summing in the workers and writing overlap
+static void run_pipelined(session_t *session, input_t *input) {
+	pthread_t output_thread;
+	if (pthread_create(&output_thread, NULL, output_stage, session) != 0) {
+		fail("error: failed to create output thread\n");
+	}
+
+	while(true) {
+		// a frame is published when it is full or before the input stage may block
+		if (!input_ready(input)) commit_frame(session);
+		const char *line;
+		size_t line_length = next_request(session, input, &line);
+		if (line_length == 0) {
+			int terminated = 0;
+			while (!try_send_termination(session, &terminated)) wait_for_space(session);
 			break;
 		}
+		while (!try_send_request(session, line, line_length)) wait_for_space(session);
+	}
+
+	if (pthread_join(output_thread, NULL) != 0) {
+		fail("error: failed to join output thread\n");
+	}
+}
 
-		// Write line to shared memory (parent to child)
-		size_t *size_ptr = (size_t *)shm_p2c;
-		*size_ptr = (size_t)line_length;
-		char *data_ptr = (char *)shm_p2c + sizeof(size_t);
-		memcpy(data_ptr, line_buffer, (size_t)line_length);
-		data_ptr[line_length] = '\0';
+static void destroy_workers(worker_t *workers, int count, size_t shm_size) {
+	for (int i = 0; i < count; ++i) {
+		if (workers[i].shm_p2c != NULL) {
+			munmap(workers[i].shm_p2c, shm_size);
+			shm_unlink(workers[i].shm_p2c_name);
+		}
+		if (workers[i].shm_c2p != NULL) {
+			munmap(workers[i].shm_c2p, shm_size);
+			shm_unlink(workers[i].shm_c2p_name);
+		}
+	}
+}
 
-		// Signal that parent has written
-		if (sem_post(sem_parent_write) == -1) {
-			fail("error: failed to post sem_parent_write\n");
+int main(int argc, char **argv) {
+	bool pipelined = false;
+	int worker_count = 1;
+	dispatch_t dispatch = DISPATCH_ROUND_ROBIN;
+	size_t ring_capacity = RING_CAPACITY;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--pipeline") == 0) {
+			pipelined = true;
+		} else if (strncmp(argv[i], "--workers=", 10) == 0) {
+			worker_count = atoi(argv[i] + 10);
+			if (worker_count < 1 || worker_count > MAX_WORKERS) {
+				fail("error: --workers must be between 1 and 64\n");
+			}
+		} else if (strcmp(argv[i], "--dispatch=round-robin") == 0) {
+			dispatch = DISPATCH_ROUND_ROBIN;
+		} else if (strcmp(argv[i], "--dispatch=depth") == 0) {
+			dispatch = DISPATCH_DEPTH;
+		} else if (strncmp(argv[i], "--segment=", 10) == 0) {
+			// ring size in MiB, rounded up to a power of two
+			int megabytes = atoi(argv[i] + 10);
+			if (megabytes < 1 || megabytes > 1024) {
+				fail("error: --segment must be between 1 and 1024 MiB\n");
+			}
+			ring_capacity = RING_CAPACITY;
+			while (ring_capacity < ((size_t)megabytes << 20)) ring_capacity *= 2;
+		} else {
+			fail("usage: lab_01_parent [--pipeline] [--workers=N] [--dispatch=round-robin|depth] [--segment=MB]\n");
 		}
+	}
+
+	static input_t input;
+	input_open(&input, STDIN_FILENO);
+	const char *first_line;
+	size_t filename_len = input_next_line(&input, &first_line, PATH_MAX);
+	if (filename_len == 0) {
+		fail("error: failed to read filename\n");
+	}
+	if (filename_len >= PATH_MAX) {
+		fail("error: filename is too long\n");
+	}
 
-		// Wait for child to read
-		if (sem_wait(sem_child_read) == -1) {
-			fail("error: failed to wait sem_child_read\n");
+	char filename[PATH_MAX];
+	memcpy(filename, first_line, filename_len);
+	filename[filename_len] = '\0';
+	trim_trailing_newline(filename);
+	if (string_length(filename) == 0) {
+		fail("error: filename must not be empty\n");
+	}
+
+	// Requests go parent -> worker, responses worker -> parent, each through its own SPSC ring
+	static worker_t workers[MAX_WORKERS];
+	size_t shm_size = ring_map_size(ring_capacity);
+	for (int i = 0; i < worker_count; ++i) {
+		// Generate unique names for shared memory rings
+		char prefix[32];
+		snprintf(prefix, sizeof(prefix), "/shm_p2c_%d", i);
+		generate_unique_name(workers[i].shm_p2c_name, sizeof(workers[i].shm_p2c_name), prefix);
+		snprintf(prefix, sizeof(prefix), "/shm_c2p_%d", i);
+		generate_unique_name(workers[i].shm_c2p_name, sizeof(workers[i].shm_c2p_name), prefix);
+
+		workers[i].shm_p2c = create_ring_segment(workers[i].shm_p2c_name, shm_size);
+		if (workers[i].shm_p2c == NULL) {
+			destroy_workers(workers, i, shm_size);
+			fail("error: failed to create parent-to-child shared memory\n");
+		}
+		workers[i].shm_c2p = create_ring_segment(workers[i].shm_c2p_name, shm_size);
+		if (workers[i].shm_c2p == NULL) {
+			destroy_workers(workers, i + 1, shm_size);
+			fail("error: failed to create child-to-parent shared memory\n");
 		}
+		ring_attach(&workers[i].requests, workers[i].shm_p2c, ring_capacity, true);
+		ring_attach(&workers[i].responses, workers[i].shm_c2p, ring_capacity, false);
+	}
 
-		// Wait for child to write response
-		if (sem_wait(sem_child_write) == -1) {
-			fail("error: failed to wait sem_child_write\n");
+	// A single worker writes the file itself; several would interleave their results,
+	// so then the parent writes them in input order and workers get "-" instead of a name
+	static output_t results;
+	if (worker_count > 1) {
+		results.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		if (results.fd == -1) {
+			destroy_workers(workers, worker_count, shm_size);
+			fail("error: failed to open file\n");
 		}
+	}
 
-		// Read response from shared memory (child to parent)
-		size_t *resp_size_ptr = (size_t *)shm_c2p;
-		size_t resp_size = *resp_size_ptr;
-		char *resp_data_ptr = (char *)shm_c2p + sizeof(size_t);
-		
-		if (resp_size > 0 && resp_size < MAX_LINE_LENGTH) {
-			forward_line(STDOUT_FILENO, resp_data_ptr);
+	// The dispatch ring only passes frame owners between the two parent stages
+	void *dispatch_memory = calloc(1, ring_map_size(DISPATCH_CAPACITY) + RING_CACHE_LINE);
+	char *response_frame = (char *)malloc(ring_capacity);
+	if (dispatch_memory == NULL || response_frame == NULL) {
+		destroy_workers(workers, worker_count, shm_size);
+		fail("error: failed to allocate dispatch ring\n");
+	}
+	static session_t session = { .output = { .fd = STDOUT_FILENO } };
+	session.workers = workers;
+	session.worker_count = worker_count;
+	session.dispatch = dispatch;
+	session.pending = -1;
+	session.frame_worker = -1;
+	session.frame_limit = ring_capacity / FRAME_SHARE;
+	// the frame header and the length of its only line
+	session.max_line = ring_capacity - ring_record_size(sizeof(uint64_t) + 2 * sizeof(uint32_t));
+	session.response_frame = response_frame;
+	session.response_capacity = ring_capacity;
+	session.results = worker_count > 1 ? &results : NULL;
+	uintptr_t aligned = ((uintptr_t)dispatch_memory + RING_CACHE_LINE - 1) & ~(uintptr_t)(RING_CACHE_LINE - 1);
+	ring_attach(&session.dispatch_writer, (void *)aligned, DISPATCH_CAPACITY, true);
+	ring_attach(&session.dispatch_reader, (void *)aligned, 0, false);
+
+	// Fork worker processes
+	for (int i = 0; i < worker_count; ++i) {
+		pid_t child = fork();
+		if (child == -1) {
+			destroy_workers(workers, worker_count, shm_size);
+			fail("error: failed to fork\n");
 		}
 
-		// Signal that parent has read
-		if (sem_post(sem_parent_read) == -1) {
-			fail("error: failed to post sem_parent_read\n");
+		if (child == 0) {
+			char child_path[PATH_MAX];
+			build_child_path(child_path, sizeof(child_path));
+			// Pass filename and shared memory names to child process
+			char *const args[] = {
+				CHILD_PROGRAM_NAME,
+				worker_count > 1 ? "-" : filename,
+				workers[i].shm_p2c_name,
+				workers[i].shm_c2p_name,
+				NULL
+			};
+			execv(child_path, args);
+			fail("error: exec failed\n");
 		}
+		workers[i].pid = child;
 	}
 
-	// Cleanup
-	munmap(shm_p2c, SHM_SIZE);
-	munmap(shm_c2p, SHM_SIZE);
-	shm_unlink(shm_parent_to_child_name);
-	shm_unlink(shm_child_to_parent_name);
-	sem_close(sem_parent_write);
-	sem_close(sem_child_read);
-	sem_close(sem_child_write);
-	sem_close(sem_parent_read);
-	sem_unlink(sem_parent_write_name);
-	sem_unlink(sem_child_read_name);
-	sem_unlink(sem_child_write_name);
-	sem_unlink(sem_parent_read_name);
-
-	// Wait for child process to finish
-	int status = 0;
-	if (waitpid(child, &status, 0) == -1) {
-		fail("error: waitpid failed\n");
-	}
-	if (WIFEXITED(status)) {
-		return WEXITSTATUS(status);
+	// Parent process: stream lines into the rings without waiting for each response
+	if (pipelined) {
+		run_pipelined(&session, &input);
 	} else {
-		return EXIT_FAILURE;
+		run_interleaved(&session, &input);
+	}
+	input_close(&input);
+
+	// Cleanup
+	destroy_workers(workers, worker_count, shm_size);
+	free(dispatch_memory);
+	free(response_frame);
+	if (worker_count > 1 && close(results.fd) == -1) {
+		fail("error: failed to close file\n");
+	}
+
+	// Wait for worker processes to finish
+	int exit_code = session.line_too_long ? EXIT_FAILURE : EXIT_SUCCESS;
+	for (int i = 0; i < worker_count; ++i) {
+		int status = 0;
+		if (waitpid(workers[i].pid, &status, 0) == -1) {
+			fail("error: waitpid failed\n");
+		}
+		if (!WIFEXITED(status)) {
+			exit_code = EXIT_FAILURE;
+		} else if (WEXITSTATUS(status) != EXIT_SUCCESS) {
+			exit_code = WEXITSTATUS(status);
+		}
 	}
-}
\ No newline at end of file
+	return exit_code;
+}
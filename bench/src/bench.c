@@ -0,0 +1,349 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "batcher.h"
+#include "oddeven.h"
+
+#define MAX_LIST 32
+#define DEFAULT_MIN_N 1000L
+#define DEFAULT_MAX_N 100000000L
+/* Четно-нечетная перестановка выполняет O(n^2) сравнений, поэтому для нее размеры ограничены */
+#define DEFAULT_MAX_QUADRATIC_N 20000L
+#define AFFINITY_COUNT 3
+
+/* Движок сортировки, участвующий в замерах */
+typedef enum {
+    ENGINE_LAB1_BLOCK,
+    ENGINE_LAB1_TRANSPOSITION,
+    ENGINE_LAB1_RADIX,
+    ENGINE_LAB2_NETWORK,
+    ENGINE_LAB2_RADIX,
+    ENGINE_COUNT
+} engine_t;
+/* Распределение входных данных */
+typedef enum {
+    DIST_RANDOM,
+    DIST_SORTED,
+    DIST_REVERSED,
+    DIST_FEW_UNIQUE,
+    DIST_ORGAN_PIPE,
+    DIST_COUNT
+} distribution_t;
+
+/* Контекст движка, создаваемый один раз на серию запусков с одним числом потоков */
+typedef struct {
+    OddEvenContext *lab1;
+    batcher_context_t *lab2;
+} engine_context_t;
+
+static const char *const engine_names[ENGINE_COUNT] = { "lab1-block", "lab1-transposition", "lab1-radix",
+                                                           "lab2-network", "lab2-radix" };
+static const char *const affinity_names[AFFINITY_COUNT] = { "none", "compact", "scatter" };
+static const char *const distribution_names[DIST_COUNT] = { "random", "sorted", "reversed", "few-unique", "organ-pipe" };
+
+/* Параметры прогона */
+typedef struct {
+    long sizes[MAX_LIST];
+    int size_count;
+    int threads[MAX_LIST];
+    int thread_count;
+    bool engines[ENGINE_COUNT];
+    bool distributions[DIST_COUNT];
+    int warmup;
+    int repeat;
+    long max_quadratic_n;
+    /* Номер в affinity_names; порядок совпадает с OddEvenAffinity и batcher_affinity_t */
+    int affinity;
+    uint64_t seed;
+    const char *output;
+} bench_options_t;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+/* Функция для заполнения массива значениями из распределения dist */
+static void generate_input(int32_t *array, long n, distribution_t dist, uint64_t seed) {
+    uint64_t state = seed ? seed : 1;
+    for (long i = 0; i < n; i++) {
+        switch (dist) {
+            case DIST_RANDOM: array[i] = (int32_t)(uint32_t)next_random(&state); break;
+            case DIST_SORTED: array[i] = (int32_t)i; break;
+            case DIST_REVERSED: array[i] = (int32_t)(n - i); break;
+            case DIST_FEW_UNIQUE: array[i] = (int32_t)(next_random(&state) % 16); break;
+            case DIST_ORGAN_PIPE: array[i] = (int32_t)(i < n / 2 ? i : n - i); break;
+            default: break;
+        }
+    }
+}
+
+static bool is_sorted(const int32_t *array, long n) {
+    for (long i = 1; i < n; i++) {
+        if (array[i] < array[i - 1]) return false;
+    }
+    return true;
+}
+
+/* Функция для создания контекста движка: выбор ядер, буфер слияния лабораторной 1 и пул потоков
+   лабораторной 2 переиспользуются всеми запусками серии и не входят в замеры */
+static bool engine_open(engine_t engine, int threads, int affinity, engine_context_t *ctx) {
+    ctx->lab1 = NULL;
+    ctx->lab2 = NULL;
+    if (engine == ENGINE_LAB2_NETWORK || engine == ENGINE_LAB2_RADIX) {
+        batcher_options_t options;
+        batcher_options_init(&options);
+        options.max_threads = threads;
+        options.engine = engine == ENGINE_LAB2_RADIX ? BATCHER_ENGINE_RADIX : BATCHER_ENGINE_NETWORK;
+        options.affinity = (batcher_affinity_t)affinity;
+        ctx->lab2 = batcher_context_create(&options);
+        return ctx->lab2 != NULL;
+    }
+    OddEvenOptions options;
+    oddeven_options_init(&options);
+    options.engine = engine == ENGINE_LAB1_BLOCK   ? ODDEVEN_ENGINE_BLOCK
+                     : engine == ENGINE_LAB1_RADIX ? ODDEVEN_ENGINE_RADIX
+                                                   : ODDEVEN_ENGINE_TRANSPOSITION;
+    options.sync = ODDEVEN_SYNC_SLEEP;
+    options.max_threads = (size_t)threads;
+    options.affinity = (OddEvenAffinity)affinity;
+    ctx->lab1 = oddeven_context_create(&options);
+    return ctx->lab1 != NULL;
+}
+
+static void engine_close(engine_context_t *ctx) {
+    if (ctx->lab1) oddeven_context_destroy(ctx->lab1);
+    if (ctx->lab2) batcher_context_destroy(ctx->lab2);
+}
+
+static bool run_engine(engine_context_t *ctx, int32_t *array, long n) {
+    if (ctx->lab2) {
+        batcher_sort(ctx->lab2, array, n);
+        return true;
+    }
+    return oddeven_sort(ctx->lab1, array, (size_t)n) != 0;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+/* Функция для получения перцентиля q по отсортированным замерам (ближайший ранг) */
+static double percentile(const double *sorted, int count, double q) {
+    int rank = (int)(q * count + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+/* Функция для разбора списка чисел через запятую */
+static int parse_list(const char *str, long *values, int max_count) {
+    int count = 0;
+    while (*str && count < max_count) {
+        char *end;
+        double value = strtod(str, &end);
+        if (end == str || value < 1) return 0;
+        values[count++] = (long)value;
+        if (*end == ',') end++;
+        else if (*end != '\0') return 0;
+        str = end;
+    }
+    return count;
+}
+/* Функция для включения элементов списка имен через запятую */
+static bool parse_names(const char *str, const char *const *names, int name_count, bool *enabled) {
+    memset(enabled, 0, (size_t)name_count * sizeof(bool));
+    while (*str) {
+        size_t length = strcspn(str, ",");
+        bool found = false;
+        for (int i = 0; i < name_count; i++) {
+            if (strlen(names[i]) == length && strncmp(str, names[i], length) == 0) {
+                enabled[i] = found = true;
+            }
+        }
+        if (!found) return false;
+        str += length;
+        if (*str == ',') str++;
+    }
+    return true;
+}
+
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  --sizes=N,N,...: array sizes (default: powers of ten from --min-n to --max-n)\n");
+    fprintf(stderr, "  --min-n=N, --max-n=N: size range (default: 1e3..1e8)\n");
+    fprintf(stderr, "  --threads=T,T,...: thread counts (default: 1, 2, 4, ... and the core count)\n");
+    fprintf(stderr, "  --engines=lab1-block,lab1-transposition,lab1-radix,lab2-network,lab2-radix (default: all)\n");
+    fprintf(stderr, "  --distributions=random,sorted,reversed,few-unique,organ-pipe (default: all)\n");
+    fprintf(stderr, "  --warmup=N: unmeasured runs before each measurement (default: 1)\n");
+    fprintf(stderr, "  --repeat=N: measured runs, reported as min/median/p95/mean (default: 5)\n");
+    fprintf(stderr, "  --max-quadratic-n=N: largest size for lab1-transposition (default: 20000)\n");
+    fprintf(stderr, "  --affinity=none|compact|scatter: pinning of sort threads to NUMA nodes (default: none)\n");
+    fprintf(stderr, "  --seed=N: seed of random inputs (default: 42)\n");
+    fprintf(stderr, "  --output=FILE: write CSV to FILE instead of stdout\n");
+}
+
+static bool parse_options(int argc, char **argv, bench_options_t *options) {
+    long min_n = DEFAULT_MIN_N;
+    long max_n = DEFAULT_MAX_N;
+    long values[MAX_LIST];
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strncmp(arg, "--sizes=", 8) == 0) {
+            options->size_count = parse_list(arg + 8, options->sizes, MAX_LIST);
+            if (options->size_count == 0) return false;
+        } else if (strncmp(arg, "--min-n=", 8) == 0) {
+            min_n = (long)strtod(arg + 8, NULL);
+        } else if (strncmp(arg, "--max-n=", 8) == 0) {
+            max_n = (long)strtod(arg + 8, NULL);
+        } else if (strncmp(arg, "--threads=", 10) == 0) {
+            options->thread_count = parse_list(arg + 10, values, MAX_LIST);
+            if (options->thread_count == 0) return false;
+            for (int t = 0; t < options->thread_count; t++) options->threads[t] = (int)values[t];
+        } else if (strncmp(arg, "--engines=", 10) == 0) {
+            if (!parse_names(arg + 10, engine_names, ENGINE_COUNT, options->engines)) return false;
+        } else if (strncmp(arg, "--distributions=", 16) == 0) {
+            if (!parse_names(arg + 16, distribution_names, DIST_COUNT, options->distributions)) return false;
+        } else if (strncmp(arg, "--warmup=", 9) == 0) {
+            options->warmup = atoi(arg + 9);
+        } else if (strncmp(arg, "--repeat=", 9) == 0) {
+            options->repeat = atoi(arg + 9);
+        } else if (strncmp(arg, "--max-quadratic-n=", 18) == 0) {
+            options->max_quadratic_n = (long)strtod(arg + 18, NULL);
+        } else if (strncmp(arg, "--affinity=", 11) == 0) {
+            options->affinity = -1;
+            for (int a = 0; a < AFFINITY_COUNT; a++) {
+                if (strcmp(arg + 11, affinity_names[a]) == 0) options->affinity = a;
+            }
+            if (options->affinity < 0) return false;
+        } else if (strncmp(arg, "--seed=", 7) == 0) {
+            options->seed = strtoull(arg + 7, NULL, 10);
+        } else if (strncmp(arg, "--output=", 9) == 0) {
+            options->output = arg + 9;
+        } else {
+            return false;
+        }
+    }
+    if (options->warmup < 0 || options->repeat < 1 || min_n < 1 || max_n < min_n) return false;
+    if (options->size_count == 0) {
+        for (long n = min_n; n <= max_n && options->size_count < MAX_LIST; n *= 10) {
+            options->sizes[options->size_count++] = n;
+        }
+    }
+    if (options->thread_count == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cores < 1) cores = 1;
+        for (long t = 1; t < cores && options->thread_count < MAX_LIST - 1; t *= 2) {
+            options->threads[options->thread_count++] = (int)t;
+        }
+        options->threads[options->thread_count++] = (int)cores;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    bench_options_t options = {
+        .warmup = 1,
+        .repeat = 5,
+        .max_quadratic_n = DEFAULT_MAX_QUADRATIC_N,
+        .seed = 42
+    };
+    for (int e = 0; e < ENGINE_COUNT; e++) options.engines[e] = true;
+    for (int d = 0; d < DIST_COUNT; d++) options.distributions[d] = true;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = stdout;
+    if (options.output) {
+        out = fopen(options.output, "w");
+        if (!out) {
+            fprintf(stderr, "Error: cannot open %s\n", options.output);
+            return EXIT_FAILURE;
+        }
+    }
+    fprintf(out, "engine,distribution,n,threads,repeat,min,median,p95,mean,speedup,efficiency\n");
+
+    long max_n = 0;
+    for (int s = 0; s < options.size_count; s++) {
+        if (options.sizes[s] > max_n) max_n = options.sizes[s];
+    }
+    int32_t *input = malloc((size_t)max_n * sizeof(int32_t));
+    int32_t *array = malloc((size_t)max_n * sizeof(int32_t));
+    double *times = malloc((size_t)options.repeat * sizeof(double));
+    if (!input || !array || !times) {
+        fprintf(stderr, "Error: failed to allocate buffers for n = %ld\n", max_n);
+        return EXIT_FAILURE;
+    }
+
+    bool failed = false;
+    for (int d = 0; d < DIST_COUNT; d++) {
+        if (!options.distributions[d]) continue;
+        for (int s = 0; s < options.size_count; s++) {
+            long n = options.sizes[s];
+            generate_input(input, n, (distribution_t)d, options.seed);
+            for (int e = 0; e < ENGINE_COUNT; e++) {
+                if (!options.engines[e]) continue;
+                if (e == ENGINE_LAB1_TRANSPOSITION && n > options.max_quadratic_n) continue;
+                /* Ускорение считается относительно медианы на одном потоке, если она измерена */
+                double serial_median = 0.0;
+                for (int t = 0; t < options.thread_count; t++) {
+                    int threads = options.threads[t];
+                    fprintf(stderr, "%s %s n=%ld threads=%d\n", engine_names[e], distribution_names[d], n, threads);
+                    engine_context_t ctx;
+                    if (!engine_open((engine_t)e, threads, options.affinity, &ctx)) {
+                        fprintf(stderr, "Error: cannot create %s context with %d threads\n", engine_names[e], threads);
+                        failed = true;
+                        continue;
+                    }
+                    for (int r = 0; r < options.warmup + options.repeat; r++) {
+                        memcpy(array, input, (size_t)n * sizeof(int32_t));
+                        double started = now_seconds();
+                        bool ran = run_engine(&ctx, array, n);
+                        double elapsed = now_seconds() - started;
+                        if (!ran || !is_sorted(array, n)) {
+                            fprintf(stderr, "Error: %s left %s input of %ld elements unsorted with %d threads\n",
+                                    engine_names[e], distribution_names[d], n, threads);
+                            failed = true;
+                        }
+                        if (r >= options.warmup) times[r - options.warmup] = elapsed;
+                    }
+                    engine_close(&ctx);
+                    qsort(times, (size_t)options.repeat, sizeof(double), compare_doubles);
+                    double mean = 0.0;
+                    for (int r = 0; r < options.repeat; r++) mean += times[r];
+                    mean /= options.repeat;
+                    double median = percentile(times, options.repeat, 0.5);
+                    if (threads == 1) serial_median = median;
+                    double speedup = serial_median > 0.0 && median > 0.0 ? serial_median / median : 0.0;
+                    fprintf(out, "%s,%s,%ld,%d,%d,%.9f,%.9f,%.9f,%.9f,%.3f,%.3f\n", engine_names[e],
+                            distribution_names[d], n, threads, options.repeat, times[0], median,
+                            percentile(times, options.repeat, 0.95), mean, speedup, speedup / threads);
+                    fflush(out);
+                }
+            }
+        }
+    }
+
+    free(input);
+    free(array);
+    free(times);
+    if (out != stdout) fclose(out);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}